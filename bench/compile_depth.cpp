@@ -0,0 +1,49 @@
+// one model and its derivatives up to METAMATH_BENCH_ORDER, built by
+// canonical_derivative() or, with METAMATH_BENCH_RAW, by derivative() (simplify() only);
+// compile_time.cmake compiles it for each order and records time and object size
+
+#include "metamath/derivative.h"
+
+#ifndef METAMATH_BENCH_ORDER
+#define METAMATH_BENCH_ORDER 3
+#endif
+
+namespace
+{
+	using namespace metamath;
+
+	template<typename E>
+	auto next(const E& e)
+	{
+#if defined(METAMATH_BENCH_RAW)
+		return derivative(e);
+#else
+		return canonical_derivative(e);
+#endif
+	}
+
+	template<int N>
+	struct chain
+	{
+		template<typename E>
+		static auto apply(const E& e)
+		{
+			return chain<N - 1>::apply(next(e));
+		}
+	};
+	template<>
+	struct chain<0>
+	{
+		template<typename E>
+		static E apply(const E& e)
+		{
+			return e;
+		}
+	};
+}
+
+float bench_model(float v)
+{
+	auto f = Sin(x) * Exp(x) / (lit<1>{} + x * x) + lit<3>{} * Ln(x) * Cos(x);
+	return chain<METAMATH_BENCH_ORDER>::apply(f)(v);
+}
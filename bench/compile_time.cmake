@@ -0,0 +1,50 @@
+# compiles compile_depth.cpp for the derivative orders 0 .. MAX_ORDER, once
+# through canonical_derivative() and once through derivative() (raw), and writes
+# order,mode,compile_ms,object_bytes lines to OUT, the time is the best of REPEAT runs
+#
+# cmake -DCXX=<compiler> -DFLAGS="<flags>" -DINC=<include dir> -DSRC=<source>
+#       -DOUT=<csv file> [-DMAX_ORDER=4] [-DREPEAT=3] -P compile_time.cmake
+
+if(NOT DEFINED MAX_ORDER)
+	set(MAX_ORDER 4)
+endif()
+if(NOT DEFINED REPEAT)
+	set(REPEAT 3)
+endif()
+
+separate_arguments(flags UNIX_COMMAND "${FLAGS}")
+get_filename_component(dir "${OUT}" DIRECTORY)
+
+set(csv "order,mode,compile_ms,object_bytes\n")
+foreach(order RANGE ${MAX_ORDER})
+	foreach(mode canonical raw)
+		set(defs -DMETAMATH_BENCH_ORDER=${order})
+		if(mode STREQUAL "raw")
+			list(APPEND defs -DMETAMATH_BENCH_RAW)
+		endif()
+		set(obj "${dir}/compile_depth_${order}_${mode}.o")
+
+		set(ms "")
+		foreach(run RANGE 1 ${REPEAT})
+			string(TIMESTAMP t0 "%s%f")
+			execute_process(COMMAND "${CXX}" ${flags} ${defs} "-I${INC}" -c "${SRC}" -o "${obj}"
+				RESULT_VARIABLE rc
+				ERROR_VARIABLE err)
+			string(TIMESTAMP t1 "%s%f")
+			if(NOT rc EQUAL 0)
+				message(FATAL_ERROR "order ${order} ${mode}:\n${err}")
+			endif()
+
+			math(EXPR t "(${t1} - ${t0}) / 1000")
+			if(ms STREQUAL "" OR t LESS ms)
+				set(ms ${t})
+			endif()
+		endforeach()
+		file(SIZE "${obj}" bytes)
+		string(APPEND csv "${order},${mode},${ms},${bytes}\n")
+		message(STATUS "order ${order} ${mode}: ${ms} ms, ${bytes} bytes")
+	endforeach()
+endforeach()
+
+file(WRITE "${OUT}" "${csv}")
+message(STATUS "written ${OUT}")
@@ -0,0 +1,175 @@
+// runtime benchmark: scalar (e(v) per point) and batch (evaluate()) evaluation of
+// the func.h functions, derivative() results, compositions, typical models,
+// their polynomial() forms and models behind a function<> handle,
+// each against a hand-written lambda of the same formula
+//
+// prints one csv line per case and mode:
+//   case,kind,type,mode,ns_per_point,lambda_ns_per_point,ratio
+// ratio is ns_per_point / lambda_ns_per_point, above 1 is abstraction overhead
+//
+// runtime_bench [points] [min_ms]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "metamath/derivative.h"
+#include "metamath/batch.h"
+#include "metamath/polynomial.h"
+#include "metamath/function.h"
+
+namespace
+{
+	using namespace metamath;
+
+	typedef std::chrono::steady_clock clock_type;
+
+	struct settings
+	{
+		std::size_t points_ = 4096;
+		double min_ms_ = 20; //per timed run, repeated over the points as needed
+		int runs_ = 5;       //the fastest run counts
+	};
+
+	template<typename T>
+	const char* type_name();
+	template<>
+	const char* type_name<float>()
+	{
+		return "float";
+	}
+	template<>
+	const char* type_name<double>()
+	{
+		return "double";
+	}
+
+	// keeps the results alive
+	volatile double sink = 0;
+
+	// ns per point of pass(in, out), the best of the runs
+	template<typename T, typename Pass>
+	double time_per_point(const settings& s, const std::vector<T>& in, std::vector<T>& out, Pass pass)
+	{
+		double best = 0;
+		for (int r = 0; r < s.runs_; ++r) {
+			std::size_t reps = 0;
+			const auto t0 = clock_type::now();
+			double ms = 0;
+			do {
+				pass(in.data(), out.data(), in.size());
+				++reps;
+				ms = std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+			}
+			while (ms < s.min_ms_);
+			const double ns = ms * 1e6 / (static_cast<double>(reps) * in.size());
+			best = r == 0 || ns < best ? ns : best;
+			sink = sink + out[out.size() / 2];
+		}
+		return best;
+	}
+
+	void print(const char* name, const char* kind, const char* type, const char* mode, double ns, double base)
+	{
+		std::printf("%s,%s,%s,%s,%.4f,%.4f,%.3f\n", name, kind, type, mode, ns, base, ns / base);
+	}
+
+	// e and the lambda l compute the same function of one variable
+	template<typename T, typename E, typename L>
+	void bench(const settings& s, const std::vector<T>& in, const char* name, const char* kind, const E& e, L l)
+	{
+		std::vector<T> out(in.size());
+
+		const double base = time_per_point(s, in, out, [l](const T* p, T* q, std::size_t n) {
+			for (std::size_t i = 0; i < n; ++i)
+				q[i] = l(p[i]);
+		});
+		const double scalar = time_per_point(s, in, out, [&e](const T* p, T* q, std::size_t n) {
+			for (std::size_t i = 0; i < n; ++i)
+				q[i] = static_cast<T>(e(p[i]));
+		});
+		const double batch = time_per_point(s, in, out, [&e](const T* p, T* q, std::size_t n) {
+			evaluate(e, p, q, n);
+		});
+
+		print(name, kind, type_name<T>(), "scalar", scalar, base);
+		print(name, kind, type_name<T>(), "batch", batch, base);
+	}
+
+	template<typename T>
+	void run(const settings& s)
+	{
+		using std::sin;
+		using std::cos;
+		using std::sqrt;
+		using std::exp;
+		using std::log;
+		using std::abs;
+
+			//(0.5, 2.5), valid for every case
+		std::vector<T> in(s.points_);
+		for (std::size_t i = 0; i < in.size(); ++i)
+			in[i] = static_cast<T>(0.5 + 2.0 * (i + 0.5) / in.size());
+
+		const var<T> v;
+
+			// func.h functions
+		bench(s, in, "sin", "function", Sin(v), [](T a) { return sin(a); });
+		bench(s, in, "cos", "function", Cos(v), [](T a) { return cos(a); });
+		bench(s, in, "sqrt", "function", Sqrt(v), [](T a) { return sqrt(a); });
+		bench(s, in, "exp", "function", Exp(v), [](T a) { return exp(a); });
+		bench(s, in, "ln", "function", Ln(v), [](T a) { return log(a); });
+		bench(s, in, "abs", "function", Abs(v - 1), [](T a) { return abs(a - 1); });
+		bench(s, in, "pow3", "function", Pow<3>(v), [](T a) { return a * a * a; });
+
+			// derivative() results
+		bench(s, in, "d_sin_exp", "derivative", derivative(Sin(v) * Exp(v)),
+			[](T a) { return cos(a) * exp(a) + sin(a) * exp(a); });
+		bench(s, in, "d_quotient", "derivative", derivative(Sin(v) / (lit<1>{} + v * v)),
+			[](T a) { const T q = 1 + a * a; return (cos(a) * q - 2 * a * sin(a)) / (q * q); });
+		bench(s, in, "d2_ln_sqrt", "derivative", derivative(derivative(Ln(Sqrt(v)))),
+			[](T a) { return T(-0.5) / (a * a); });
+
+			// compositions
+		bench(s, in, "ln_of_3x", "composition", Ln(v)(3 * v), [](T a) { return log(3 * a); });
+		bench(s, in, "sin_of_exp", "composition", Sin(v)(Exp(v) + 1), [](T a) { return sin(exp(a) + 1); });
+
+			// models
+		bench(s, in, "quadratic", "model", 3 * v * v + 2 * v + 1, [](T a) { return 3 * a * a + 2 * a + 1; });
+		bench(s, in, "cubic", "model", Pow<3>(v) - 4 * v, [](T a) { return a * a * a - 4 * a; });
+		bench(s, in, "quintic", "model", ((((2 * v - 3) * v + 1) * v - 5) * v + 7) * v - 1,
+			[](T a) { return ((((2 * a - 3) * a + 1) * a - 5) * a + 7) * a - 1; });
+		bench(s, in, "trig", "model", 4 * Sin(2 * v) + Cos(v) / 2, [](T a) { return 4 * sin(2 * a) + cos(a) / 2; });
+		bench(s, in, "damped", "model", Exp(-v / 4) * Sin(3 * v), [](T a) { return exp(-a / 4) * sin(3 * a); });
+
+		// polynomial() forms of models
+		bench(s, in, "quadratic", "polynomial", polynomial(3 * v * v + 2 * v + 1, v), [](T a) { return 3 * a * a + 2 * a + 1; });
+		bench(s, in, "d_quintic", "polynomial", polynomial(derivative(((((2 * v - 3) * v + 1) * v - 5) * v + 7) * v - 1), v),
+			[](T a) { return (((10 * a - 12) * a + 3) * a - 10) * a + 7; });
+		bench(s, in, "quartic", "polynomial", polynomial(2 * v * v * v * v - 3 * v * v * v + v * v - 5 * v + 7, v),
+			[](T a) { return 2 * a * a * a * a - 3 * a * a * a + a * a - 5 * a + 7; });
+
+			// type-erased handles of models, one indirect call per point (scalar) or per array (batch)
+		typedef function<T(T)> handle;
+		bench(s, in, "quadratic", "handle", handle(3 * v * v + 2 * v + 1), [](T a) { return 3 * a * a + 2 * a + 1; });
+		bench(s, in, "damped", "handle", handle(Exp(-v / 4) * Sin(3 * v)), [](T a) { return exp(-a / 4) * sin(3 * a); });
+		bench(s, in, "d_sin_exp", "handle", derivative(handle(Sin(v) * Exp(v), derivative(Sin(v) * Exp(v)))),
+			[](T a) { return cos(a) * exp(a) + sin(a) * exp(a); });
+	}
+}
+
+int main(int argc, char** argv)
+{
+	settings s;
+	if (argc > 1)
+		s.points_ = std::max<long>(1, std::atol(argv[1]));
+	if (argc > 2)
+		s.min_ms_ = std::atof(argv[2]);
+
+	std::printf("case,kind,type,mode,ns_per_point,lambda_ns_per_point,ratio\n");
+	run<float>(s);
+	run<double>(s);
+	return sink == 12345.678 ? 1 : 0;
+}
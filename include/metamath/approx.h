@@ -0,0 +1,479 @@
+#ifndef H_A3FB6C67C9E14C02A1411C2BF8BA8101
+#define H_A3FB6C67C9E14C02A1411C2BF8BA8101
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include "batch.h"
+
+namespace metamath
+{
+	namespace approx
+	{
+		// precision policies
+		//
+		struct exact;  //the std:: functions
+		struct fast;   //polynomial kernels, ~1e-7 relative error
+		struct coarse; //polynomial kernels, ~1e-4 relative error
+
+		// The kernels are branch-free (lane loops over them vectorize) and inline,
+		// infinities, NaN and the ends of the exp and log ranges give the std::
+		// results, log scales subnormal arguments into the normal range and exp
+		// rounds its results below the smallest normal number to subnormals
+		// (the relative error grows there as the precision drops). sin and cos
+		// reduce their argument accurately up to ieee::max_trig (1e4 for float,
+		// 1e6 for double) and call std:: beyond, a block does so only for its
+		// lanes out of range. Measured maximal relative error,
+		// including rounding for float (1 ulp = 6e-8):
+		//
+		//               float fast   float coarse   double fast   double coarse
+		//   exp         2.2e-7       7.5e-5         7.5e-8        7.5e-5
+		//   log         2.3e-7       2.3e-5         7e-10         2.3e-5
+		//   sin, cos    1.8e-7       1.2e-5         3.3e-8        1.2e-5
+		//
+		// sin and cos are measured for |x| < max_trig and |f| > 1e-3, the absolute
+		// error near their zeros stays below the same bounds. log of subnormals
+		// (1e-40f, 1.4e-45f, 5e-324) stays within its bounds, the subnormal results
+		// of exp (expf(-87.5), expf(-100), exp(-740)) match std:: to the last bit.
+		// sqrt is a single vector instruction already and stays exact.
+
+		template<typename T>
+		struct ieee;
+
+		template<>
+		struct ieee<float>
+		{
+			typedef std::int32_t int_t;
+			static constexpr int mant = 23;
+			static constexpr int bias = 127;
+			static constexpr float max_log = 88.72283f;  //exp overflows above
+			static constexpr float min_log = -103.97208f; //and is 0 below
+			static constexpr float ln2_hi = 0.693145751953125f;
+			static constexpr float ln2_lo = 1.428606765330187e-06f;
+			static constexpr float pio2_1 = 1.5703125f;  //pi / 2 in 3 parts,
+			static constexpr float pio2_2 = 4.837512969970703e-04f;  //k * part is exact
+			static constexpr float pio2_3 = 7.549790126404332e-08f;
+			static constexpr float max_trig = 1e4f; //sin and cos reduce accurately below
+		};
+		template<>
+		struct ieee<double>
+		{
+			typedef std::int64_t int_t;
+			static constexpr int mant = 52;
+			static constexpr int bias = 1023;
+			static constexpr double max_log = 709.782712893384;
+			static constexpr double min_log = -745.1332191019412;
+			static constexpr double ln2_hi = 6.93147180369123816490e-01;
+			static constexpr double ln2_lo = 1.90821492927058770002e-10;
+			static constexpr double pio2_1 = 1.57079632673412561417e+00;
+			static constexpr double pio2_2 = 6.07710050650619224932e-11;
+			static constexpr double pio2_3 = 2.02226624879595063154e-21;
+			static constexpr double max_trig = 1e6;
+		};
+
+		template<typename T, typename I>
+		METAMATH_KERNEL T from_bits(I i)
+		{
+			static_assert(sizeof(T) == sizeof(I), "size mismatch");
+			T v;
+			std::memcpy(&v, &i, sizeof(T));
+			return v;
+		}
+		template<typename T>
+		METAMATH_KERNEL typename ieee<T>::int_t to_bits(T v)
+		{
+			typename ieee<T>::int_t i;
+			std::memcpy(&i, &v, sizeof(T));
+			return i;
+		}
+
+		// c ? a : b on the bits; gcc leaves ?: on floats as branches whenever
+		// a comparison could trap, and branches stop the lane loops from vectorizing
+		template<typename T>
+		METAMATH_KERNEL T select(bool c, T a, T b)
+		{
+			typedef typename ieee<T>::int_t I;
+			const I m = -static_cast<I>(c);
+			return from_bits<T>((to_bits(a) & m) | (to_bits(b) & ~m));
+		}
+
+		// c0 + x * (c1 + x * (...))
+		template<typename T>
+		METAMATH_KERNEL T horner(T, double c)
+		{
+			return static_cast<T>(c);
+		}
+		template<typename T, typename... C>
+		METAMATH_KERNEL T horner(T x, double c, C... cs)
+		{
+			return static_cast<T>(c) + x * horner(x, cs...);
+		}
+
+		// minimax polynomials (relative error) on the reduced ranges:
+		// exp(r) on [-ln2/2, ln2/2], sin(r)/r and cos(r) in r^2 on [0, pi/4],
+		// atanh(t)/t in t^2 on [0, 3 - 2 sqrt(2)]
+		//
+		template<typename P>
+		struct poly;
+
+		template<>
+		struct poly<fast>
+		{
+			template<typename T>
+			METAMATH_KERNEL static T exp(T r)
+			{
+				return horner(r, 1.0000000716546416, 0.9999996919922827, 0.4999889485147265,
+					0.16667574726751733, 0.041915381977903184, 0.008297655198143187);
+			}
+			template<typename T>
+			METAMATH_KERNEL static T sin(T s)
+			{
+				return horner(s, 0.9999999967617988, -0.16666650224240995, 0.00833201645312821,
+					-0.0001950182202048996);
+			}
+			template<typename T>
+			METAMATH_KERNEL static T cos(T s)
+			{
+				return horner(s, 0.9999999673862963, -0.49999842434232994, 0.041654419562639565,
+					-0.0013579404088793488);
+			}
+			template<typename T>
+			METAMATH_KERNEL static T atanh(T u)
+			{
+				return horner(u, 0.9999999993106652, 0.3333340797543326, 0.19987397461560594,
+					0.14962825372622557);
+			}
+		};
+
+		template<>
+		struct poly<coarse>
+		{
+			template<typename T>
+			METAMATH_KERNEL static T exp(T r)
+			{
+				return horner(r, 0.9999280735351597, 1.0001641857566361, 0.5049632642434794,
+					0.16566842353293626);
+			}
+			template<typename T>
+			METAMATH_KERNEL static T sin(T s)
+			{
+				return horner(s, 0.9999984928873352, -0.1666238230900229, 0.008150056555948818);
+			}
+			template<typename T>
+			METAMATH_KERNEL static T cos(T s)
+			{
+				return horner(s, 0.9999882169223083, -0.499685484728646, 0.040362293936049766);
+			}
+			template<typename T>
+			METAMATH_KERNEL static T atanh(T u)
+			{
+				return horner(u, 0.9999777446772801, 0.339339928793373);
+			}
+		};
+
+		// kernels
+		//
+		template<typename P, typename T>
+		METAMATH_KERNEL T exp_k(T x)
+		{
+			typedef ieee<T> fp;
+			typedef typename fp::int_t I;
+
+			T xc = select(x > fp::max_log, T(fp::max_log), x);
+			xc = select(!(xc >= fp::min_log), T(fp::min_log), xc); //also NaN, for the cast
+			const I n = static_cast<I>(xc * static_cast<T>(1.4426950408889634) + select(xc < 0, T(-0.5), T(0.5)));
+			const T k = static_cast<T>(n);
+			const T r = xc - k * fp::ln2_hi - k * fp::ln2_lo;
+				// 2^n, built in two normal halves so that n = bias and the
+				// subnormal results (n down to -bias - mant) are not out of range
+			const T h = from_bits<T>(static_cast<I>(n / 2 + fp::bias) << fp::mant);
+			const T e = from_bits<T>(static_cast<I>(n - n / 2 + fp::bias) << fp::mant);
+			T v = poly<P>::exp(r) * h * e;
+			v = select(x > fp::max_log, std::numeric_limits<T>::infinity(), v);
+			v = select(x < fp::min_log, T(0), v);
+			return select(x != x, x, v);
+		}
+
+		template<typename P, typename T>
+		METAMATH_KERNEL T log_k(T x)
+		{
+			typedef ieee<T> fp;
+			typedef typename fp::int_t I;
+
+				// subnormals times 2^mant are normal
+			const bool sub = x < std::numeric_limits<T>::min();
+			const I i = to_bits(select(sub, x * static_cast<T>(static_cast<I>(1) << fp::mant), x));
+			const I mmask = (static_cast<I>(1) << fp::mant) - 1;
+			T e = static_cast<T>(((i >> fp::mant) & (2 * fp::bias + 1)) - fp::bias)
+				- select(sub, static_cast<T>(fp::mant), T(0));
+			T m = from_bits<T>(static_cast<I>((i & mmask) | (static_cast<I>(fp::bias) << fp::mant))); //[1, 2)
+				// m in [sqrt(1/2), sqrt(2))
+			const bool hi = m > static_cast<T>(1.4142135623730951);
+			m = select(hi, m * T(0.5), m);
+			e = select(hi, e + T(1), e);
+
+			const T t = (m - T(1)) / (m + T(1));
+			T v = T(2) * t * poly<P>::atanh(t * t) + e * fp::ln2_lo + e * fp::ln2_hi;
+			v = select(x == std::numeric_limits<T>::infinity(), x, v);
+			v = select(x == 0, -std::numeric_limits<T>::infinity(), v);
+			return select(!(x >= 0), std::numeric_limits<T>::quiet_NaN(), v); //also NaN
+		}
+
+		// the arguments sin_k reduces accurately, not NaN or infinities
+		template<typename T>
+		METAMATH_KERNEL bool trig_range(T x)
+		{
+			return std::abs(x) <= ieee<T>::max_trig;
+		}
+
+		// sin(x) for q = 0, cos(x) for q = 1, |x| <= max_trig
+		template<typename P, typename T>
+		METAMATH_KERNEL T sin_k(T x, int q)
+		{
+			typedef ieee<T> fp;
+			typedef typename fp::int_t I;
+
+				// the range is left to the callers, xr only keeps the cast defined
+			const T xr = select(trig_range(x), x, T(0));
+			const I n = static_cast<I>(xr * static_cast<T>(0.6366197723675814) + select(xr < 0, T(-0.5), T(0.5)));
+			const T k = static_cast<T>(n);
+			const T r = ((xr - k * fp::pio2_1) - k * fp::pio2_2) - k * fp::pio2_3; //[-pi/4, pi/4]
+			const T s = r * r;
+			const T sr = r * poly<P>::sin(s);
+			const T cr = poly<P>::cos(s);
+			const I j = n + q;
+			const T v = select((j & 1) != 0, cr, sr);
+			return from_bits<T>(to_bits(v) ^ (to_bits(T(-0.0)) & -((j >> 1) & 1))); //negated in quadrants 2, 3
+		}
+
+		template<typename U>
+		using if_scalar = std::enable_if_t<std::is_arithmetic<U>::value>;
+
+		// a number evaluated with the policy P, the func.h functors
+		// find its sin, cos, exp, log, sqrt and abs through ADL
+		template<typename T, typename P>
+		struct real
+		{
+			typedef T type;
+
+			T v_;
+
+			real() = default;
+			template<typename U, typename = if_scalar<U>>
+			constexpr real(U v)
+				:v_{static_cast<T>(v)}
+			{
+			}
+		};
+
+#define METAMATH_REAL_OP(OP) \
+		template<typename T, typename P> \
+		constexpr real<T, P> operator OP(const real<T, P>& a, const real<T, P>& b) \
+		{ \
+			return {a.v_ OP b.v_}; \
+		} \
+		template<typename T, typename P, typename U, typename = if_scalar<U>> \
+		constexpr real<T, P> operator OP(const real<T, P>& a, U b) \
+		{ \
+			return {a.v_ OP static_cast<T>(b)}; \
+		} \
+		template<typename U, typename T, typename P, typename = if_scalar<U>> \
+		constexpr real<T, P> operator OP(U a, const real<T, P>& b) \
+		{ \
+			return {static_cast<T>(a) OP b.v_}; \
+		}
+
+		METAMATH_REAL_OP(+)
+		METAMATH_REAL_OP(-)
+		METAMATH_REAL_OP(*)
+		METAMATH_REAL_OP(/)
+
+#undef METAMATH_REAL_OP
+
+		template<typename T, typename P>
+		constexpr real<T, P> operator-(const real<T, P>& a)
+		{
+			return {-a.v_};
+		}
+
+		// math, by policy
+		//
+		template<typename P>
+		struct math
+		{
+			template<typename T> METAMATH_KERNEL static T sin(T v) { return trig_range(v) ? sin_k<P>(v, 0) : std::sin(v); }
+			template<typename T> METAMATH_KERNEL static T cos(T v) { return trig_range(v) ? sin_k<P>(v, 1) : std::cos(v); }
+			template<typename T> METAMATH_KERNEL static T exp(T v) { return exp_k<P>(v); }
+			template<typename T> METAMATH_KERNEL static T log(T v) { return log_k<P>(v); }
+		};
+		template<>
+		struct math<exact>
+		{
+			template<typename T> METAMATH_KERNEL static T sin(T v) { return std::sin(v); }
+			template<typename T> METAMATH_KERNEL static T cos(T v) { return std::cos(v); }
+			template<typename T> METAMATH_KERNEL static T exp(T v) { return std::exp(v); }
+			template<typename T> METAMATH_KERNEL static T log(T v) { return std::log(v); }
+		};
+
+		template<typename T, typename P>
+		METAMATH_KERNEL real<T, P> sin(const real<T, P>& a)
+		{
+			return {math<P>::sin(a.v_)};
+		}
+		template<typename T, typename P>
+		METAMATH_KERNEL real<T, P> cos(const real<T, P>& a)
+		{
+			return {math<P>::cos(a.v_)};
+		}
+
+		// sin and cos of a block: the kernel on all lanes without a branch,
+		// then std:: on the lanes out of its range, if there are any; the
+		// fallback stays out of line, inlined it stops the kernel loop from vectorizing
+		template<typename T, std::size_t N>
+#if defined(_MSC_VER)
+		__declspec(noinline)
+#else
+		__attribute__((noinline))
+#endif
+		void trig_fallback(const T* x, T* r, int q)
+		{
+			for (std::size_t i = 0; i < N; ++i)
+				if (!trig_range(x[i]))
+					r[i] = q ? std::cos(x[i]) : std::sin(x[i]);
+		}
+		template<typename T, typename P, std::size_t N>
+		METAMATH_KERNEL simd::pack<real<T, P>, N> trig(const simd::pack<real<T, P>, N>& a, int q)
+		{
+			typedef typename ieee<T>::int_t I;
+
+			T x[N], r[N];
+			I m = 0; //the largest |x| as bits, NaN above infinity
+			for (std::size_t i = 0; i < N; ++i) {
+				x[i] = a.v_[i].v_;
+				r[i] = sin_k<P>(x[i], q);
+				const I b = to_bits(x[i]) & ~to_bits(T(-0.0));
+				m = b > m ? b : m;
+			}
+			if (m > to_bits(ieee<T>::max_trig))
+				trig_fallback<T, N>(x, r, q);
+			simd::pack<real<T, P>, N> v;
+			for (std::size_t i = 0; i < N; ++i)
+				v.v_[i].v_ = r[i];
+			return v;
+		}
+		template<typename T, typename P, std::size_t N, typename = std::enable_if_t<!std::is_same<P, exact>::value>>
+		simd::pack<real<T, P>, N> sin(const simd::pack<real<T, P>, N>& a)
+		{
+			return trig(a, 0);
+		}
+		template<typename T, typename P, std::size_t N, typename = std::enable_if_t<!std::is_same<P, exact>::value>>
+		simd::pack<real<T, P>, N> cos(const simd::pack<real<T, P>, N>& a)
+		{
+			return trig(a, 1);
+		}
+
+		template<typename T, typename P>
+		METAMATH_KERNEL real<T, P> exp(const real<T, P>& a)
+		{
+			return {math<P>::exp(a.v_)};
+		}
+		template<typename T, typename P>
+		METAMATH_KERNEL real<T, P> log(const real<T, P>& a)
+		{
+			return {math<P>::log(a.v_)};
+		}
+		template<typename T, typename P>
+		METAMATH_KERNEL real<T, P> sqrt(const real<T, P>& a)
+		{
+			return {std::sqrt(a.v_)};
+		}
+		template<typename T, typename P>
+		METAMATH_KERNEL real<T, P> abs(const real<T, P>& a)
+		{
+			return {std::abs(a.v_)};
+		}
+
+		// moves arguments into the policy domain and results back out,
+		// scalars and simd packs are supported, other domains pass as they are
+		template<typename P>
+		struct convert
+		{
+			template<typename V, typename = std::enable_if_t<!std::is_arithmetic<V>::value>>
+			static V in(const V& v)
+			{
+				return v;
+			}
+			template<typename T, typename = if_scalar<T>>
+			static real<T, P> in(T v)
+			{
+				return {v};
+			}
+			template<typename T, std::size_t N>
+			static simd::pack<real<T, P>, N> in(const simd::pack<T, N>& v)
+			{
+				simd::pack<real<T, P>, N> r;
+				for (std::size_t i = 0; i < N; ++i)
+					r.v_[i] = {v.v_[i]};
+				return r;
+			}
+
+			template<typename V>
+			static V out(const V& v)
+			{
+				return v;
+			}
+			template<typename T>
+			static T out(const real<T, P>& v)
+			{
+				return v.v_;
+			}
+			template<typename T, std::size_t N>
+			static simd::pack<T, N> out(const simd::pack<real<T, P>, N>& v)
+			{
+				simd::pack<T, N> r;
+				for (std::size_t i = 0; i < N; ++i)
+					r.v_[i] = v.v_[i].v_;
+				return r;
+			}
+		};
+
+		// an expression evaluated with the policy P
+		template<typename E, typename P>
+		struct expr
+		{
+			E e_;
+
+			template<typename V>
+			auto operator()(const V& v) const
+			{
+				return convert<P>::out(e_(convert<P>::in(v)));
+			}
+
+			template<typename Os>
+			Os& print(Os& os) const
+			{
+				os << e_;
+				return os;
+			}
+		};
+	}
+
+	// per expression: with_precision<approx::fast>(f)(x), evaluate(with_precision<...>(f), ...)
+	template<typename P, typename E>
+	approx::expr<E, P> with_precision(const E& e)
+	{
+		return {e};
+	}
+
+	// per evaluation call: evaluate<approx::coarse>(f, in, out, n)
+	template<typename P, typename E, typename T, typename R>
+	void evaluate(const E& e, const T* in, R* out, std::size_t n)
+	{
+		evaluate(with_precision<P>(e), in, out, n);
+	}
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef H_1989D4548DF94D4F91CC5F04AAFB1FF1
+#define H_1989D4548DF94D4F91CC5F04AAFB1FF1
+
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#include "exp.h"
+
+// kernels of number types (approx::real, mixed::num) are inlined into the
+// lane loops of simd::pack, where the inliner would otherwise give up after unrolling
+#if defined(_MSC_VER)
+#define METAMATH_KERNEL __forceinline
+#else
+#define METAMATH_KERNEL inline __attribute__((always_inline))
+#endif
+
+namespace metamath
+{
+	struct sin_f;
+	struct cos_f;
+	struct exponent_f;
+	struct ln_f;
+
+	namespace simd
+	{
+		// vector register width (bytes) of the target instruction set
+#if defined(__AVX512F__)
+		static constexpr std::size_t width = 64;
+#elif defined(__AVX__)
+		static constexpr std::size_t width = 32;
+#else
+		static constexpr std::size_t width = 16; //SSE2, NEON
+#endif
+
+		// number of T lanes in one register
+		template<typename T>
+		struct lanes
+		{
+			static constexpr std::size_t value = (width / sizeof(T)) ? (width / sizeof(T)) : 1;
+		};
+
+		// a block of N lanes evaluated together
+		// the arithmetic lane loops below are plain fixed-count loops the
+		// compiler maps onto SSE/AVX/AVX-512 registers, sqrt uses the vector
+		// instruction, sin, cos, exp and log call the C library once per lane
+		template<typename T, std::size_t N>
+		struct pack
+		{
+			typedef T type;
+			static constexpr std::size_t size = N;
+
+			T v_[N];
+
+			constexpr pack()
+				:v_{}
+			{
+			}
+
+			// broadcast a scalar to all lanes
+			template<typename U, typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+			constexpr pack(U s)
+				:v_{}
+			{
+				for (std::size_t i = 0; i < N; ++i)
+					v_[i] = static_cast<T>(s);
+			}
+
+			constexpr T& operator[](std::size_t i)
+			{
+				return v_[i];
+			}
+			constexpr const T& operator[](std::size_t i) const
+			{
+				return v_[i];
+			}
+
+			static pack load(const T* p)
+			{
+				pack r;
+				for (std::size_t i = 0; i < N; ++i)
+					r.v_[i] = p[i];
+				return r;
+			}
+			template<typename R>
+			void store(R* p) const
+			{
+				for (std::size_t i = 0; i < N; ++i)
+					p[i] = v_[i];
+			}
+		};
+
+		template<typename U>
+		using if_scalar = std::enable_if_t<std::is_arithmetic<U>::value>;
+
+		// lane-wise arithmetic
+		//
+#define METAMATH_PACK_OP(OP) \
+		template<typename T, std::size_t N> \
+		constexpr pack<T, N> operator OP(const pack<T, N>& a, const pack<T, N>& b) \
+		{ \
+			pack<T, N> r; \
+			for (std::size_t i = 0; i < N; ++i) \
+				r.v_[i] = a.v_[i] OP b.v_[i]; \
+			return r; \
+		} \
+		template<typename T, std::size_t N, typename U, typename = if_scalar<U>> \
+		constexpr pack<T, N> operator OP(const pack<T, N>& a, U s) \
+		{ \
+			pack<T, N> r; \
+			const T b = static_cast<T>(s); \
+			for (std::size_t i = 0; i < N; ++i) \
+				r.v_[i] = a.v_[i] OP b; \
+			return r; \
+		} \
+		template<typename U, typename T, std::size_t N, typename = if_scalar<U>> \
+		constexpr pack<T, N> operator OP(U s, const pack<T, N>& b) \
+		{ \
+			pack<T, N> r; \
+			const T a = static_cast<T>(s); \
+			for (std::size_t i = 0; i < N; ++i) \
+				r.v_[i] = a OP b.v_[i]; \
+			return r; \
+		}
+
+		METAMATH_PACK_OP(+)
+		METAMATH_PACK_OP(-)
+		METAMATH_PACK_OP(*)
+		METAMATH_PACK_OP(/)
+
+#undef METAMATH_PACK_OP
+
+		template<typename T, std::size_t N>
+		constexpr pack<T, N> operator-(const pack<T, N>& a)
+		{
+			pack<T, N> r;
+			for (std::size_t i = 0; i < N; ++i)
+				r.v_[i] = -a.v_[i];
+			return r;
+		}
+
+		// lane-wise math, picked up by the func.h functors through ADL
+		// the calls set errno, so these loops stay scalar
+		//
+#define METAMATH_PACK_FUNC(NAME) \
+		template<typename T, std::size_t N> \
+		pack<T, N> NAME(const pack<T, N>& a) \
+		{ \
+			using std::NAME; \
+			pack<T, N> r; \
+			for (std::size_t i = 0; i < N; ++i) \
+				r.v_[i] = NAME(a.v_[i]); \
+			return r; \
+		}
+
+		METAMATH_PACK_FUNC(sin)
+		METAMATH_PACK_FUNC(cos)
+		METAMATH_PACK_FUNC(sqrt)
+		METAMATH_PACK_FUNC(exp)
+		METAMATH_PACK_FUNC(log)
+		METAMATH_PACK_FUNC(abs)
+
+#undef METAMATH_PACK_FUNC
+
+#if defined(__SSE2__) || defined(_M_X64)
+		// sqrtps/sqrtpd, the lanes past the last full register go through std::
+		//
+#if defined(__AVX__)
+#define METAMATH_SQRT_256(SUFFIX) \
+			for (; i + 2 * L <= N; i += 2 * L) \
+				_mm256_storeu_##SUFFIX(r.v_ + i, _mm256_sqrt_##SUFFIX(_mm256_loadu_##SUFFIX(a.v_ + i)));
+#else
+#define METAMATH_SQRT_256(SUFFIX)
+#endif
+#define METAMATH_PACK_SQRT(T, SUFFIX) \
+		template<std::size_t N> \
+		pack<T, N> sqrt(const pack<T, N>& a) \
+		{ \
+			constexpr std::size_t L = 16 / sizeof(T); \
+			pack<T, N> r; \
+			std::size_t i = 0; \
+			METAMATH_SQRT_256(SUFFIX) \
+			for (; i + L <= N; i += L) \
+				_mm_storeu_##SUFFIX(r.v_ + i, _mm_sqrt_##SUFFIX(_mm_loadu_##SUFFIX(a.v_ + i))); \
+			for (; i < N; ++i) \
+				r.v_[i] = std::sqrt(a.v_[i]); \
+			return r; \
+		}
+
+		METAMATH_PACK_SQRT(float, ps)
+		METAMATH_PACK_SQRT(double, pd)
+
+#undef METAMATH_PACK_SQRT
+#undef METAMATH_SQRT_256
+#endif
+
+		// functions whose lanes call the C library one at a time
+		template<typename F>
+		struct libm_call : std::false_type {};
+		template<>
+		struct libm_call<sin_f> : std::true_type {};
+		template<>
+		struct libm_call<cos_f> : std::true_type {};
+		template<>
+		struct libm_call<exponent_f> : std::true_type {};
+		template<>
+		struct libm_call<ln_f> : std::true_type {};
+
+		// whether an expression has such a call, blocks of it run no faster
+		// than single points and spill the other lanes around every call
+		template<typename E>
+		struct has_libm_call : std::false_type {};
+		template<typename E1, typename E2, typename Op>
+		struct has_libm_call<metamath::exp<E1, E2, Op>>
+			: std::integral_constant<bool, has_libm_call<E1>::value || has_libm_call<E2>::value> {};
+		template<typename E, typename F>
+		struct has_libm_call<metamath::exp<E, F, func>>
+			: std::integral_constant<bool, libm_call<F>::value || has_libm_call<E>::value> {};
+
+		// writes a block result, constant expressions yield a scalar
+		template<std::size_t N, typename U, typename R>
+		void store(U v, R* p)
+		{
+			for (std::size_t i = 0; i < N; ++i)
+				p[i] = v;
+		}
+		template<std::size_t N, typename T, std::size_t M, typename R>
+		void store(const pack<T, M>& v, R* p)
+		{
+			static_assert(N == M, "lane count mismatch");
+			v.store(p);
+		}
+	}
+
+	template<typename T, std::size_t N>
+	struct is_block<simd::pack<T, N>> : std::true_type {};
+
+	// batch evaluation: out[i] = e(in[i]), i = [0, n)
+	// full blocks go through the lane kernels, the tail through one-lane
+	// packs, so every point is evaluated in T (a scalar argument would
+	// take the domain of the variable, float for x)
+	// expressions with sin, cos, exp or log go point by point
+	template<typename E, typename T, typename R>
+	void evaluate(const E& e, const T* in, R* out, std::size_t n)
+	{
+		constexpr std::size_t N = simd::has_libm_call<E>::value ? 1 : simd::lanes<T>::value;
+		typedef simd::pack<T, N> pack_t;
+		typedef simd::pack<T, 1> lane_t;
+
+		std::size_t i = 0;
+		for (; i + N <= n; i += N) {
+			simd::store<N>(e(pack_t::load(in + i)), out + i);
+		}
+		for (; i < n; ++i) {
+			simd::store<1>(e(lane_t::load(in + i)), out + i);
+		}
+	}
+
+	// in-place form
+	template<typename E, typename T>
+	void evaluate(const E& e, T* inout, std::size_t n)
+	{
+		evaluate(e, static_cast<const T*>(inout), inout, n);
+	}
+}
+
+#endif
@@ -0,0 +1,723 @@
+#ifndef H_3BBFCC2609EA47188247F4241A736474
+#define H_3BBFCC2609EA47188247F4241A736474
+
+#include <type_traits>
+#include <utility>
+#include "func.h"
+#include "simplify.h"
+
+namespace metamath
+{
+	// function kinds, only used to order operands
+	// unknown functions share 0, they keep their order among each other
+	template<typename F>
+	struct func_id
+	{
+		static constexpr unsigned value = 0;
+	};
+	template<>
+	struct func_id<sin_f>
+	{
+		static constexpr unsigned value = 1;
+	};
+	template<>
+	struct func_id<cos_f>
+	{
+		static constexpr unsigned value = 2;
+	};
+	template<>
+	struct func_id<sqrt_f>
+	{
+		static constexpr unsigned value = 3;
+	};
+	template<>
+	struct func_id<exponent_f>
+	{
+		static constexpr unsigned value = 4;
+	};
+	template<>
+	struct func_id<ln_f>
+	{
+		static constexpr unsigned value = 5;
+	};
+	template<>
+	struct func_id<abs_f>
+	{
+		static constexpr unsigned value = 6;
+	};
+	template<int N>
+	struct func_id<pow_f<N>>
+	{
+		static constexpr unsigned value = 64 + static_cast<unsigned>(N);
+	};
+
+	// the value is given by the type alone: literals, variables and
+	// what is built of them, two such expressions of one type are equal
+	template<typename E, typename = void>
+	struct is_static : std::false_type {};
+	template<int N>
+	struct is_static<lit<N>> : std::true_type {};
+	template<typename T, typename Tag>
+	struct is_static<exp<T, Tag, variable>> : std::true_type {};
+	template<typename E, typename F>
+	struct is_static<exp<E, F, func>>
+		: std::integral_constant<bool, std::is_empty<F>::value && is_static<E>::value> {};
+	template<typename E>
+	struct is_static<exp<E, empty, negate>> : is_static<E> {};
+	template<typename E1, typename E2, typename Op>
+	struct is_static<exp<E1, E2, Op>, std::enable_if_t<is_binary_op<Op>::value>>
+		: std::integral_constant<bool, is_static<E1>::value && is_static<E2>::value> {};
+
+	namespace canon
+	{
+		typedef unsigned long long key;
+
+		constexpr key mix(key h, key v)
+		{
+			return h ^ (v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2));
+		}
+		// compound nodes sort after literals (0), constants and parameters (1) and variables (2)
+		constexpr key node(key h)
+		{
+			return (key(3) << 60) | (h >> 4);
+		}
+
+		template<typename Op>
+		struct op_id;
+		template<>
+		struct op_id<plus>
+		{
+			static constexpr key value = 1;
+		};
+		template<>
+		struct op_id<minus>
+		{
+			static constexpr key value = 2;
+		};
+		template<>
+		struct op_id<mult>
+		{
+			static constexpr key value = 3;
+		};
+		template<>
+		struct op_id<div>
+		{
+			static constexpr key value = 4;
+		};
+	}
+
+	// structural sort key of an expression type, the same in every translation unit
+	//
+	template<typename E, typename = void>
+	struct order_key
+	{
+		static constexpr canon::key value = canon::node(0);
+	};
+	template<int N>
+	struct order_key<lit<N>>
+	{
+		static constexpr canon::key value = static_cast<canon::key>(static_cast<long long>(N) + 0x80000000ll);
+	};
+	template<typename T>
+	struct order_key<exp<T, empty, constant>>
+	{
+		static constexpr canon::key value = canon::key(1) << 60;
+	};
+	template<typename T>
+	struct order_key<exp<T, empty, parameter>>
+	{
+		static constexpr canon::key value = (canon::key(1) << 60) | 1;
+	};
+	template<typename T, typename Tag>
+	struct order_key<exp<T, Tag, variable>>
+	{
+		static constexpr canon::key value = (canon::key(2) << 60) | static_cast<canon::key>(var_index<Tag>::value);
+	};
+	template<typename E, typename F>
+	struct order_key<exp<E, F, func>>
+	{
+		static constexpr canon::key value = canon::node(canon::mix(canon::mix(16, func_id<F>::value), order_key<E>::value));
+	};
+	template<typename E>
+	struct order_key<exp<E, empty, negate>>
+	{
+		static constexpr canon::key value = canon::node(canon::mix(5, order_key<E>::value));
+	};
+	template<typename E1, typename E2, typename Op>
+	struct order_key<exp<E1, E2, Op>, std::enable_if_t<is_binary_op<Op>::value>>
+	{
+		static constexpr canon::key value = canon::node(canon::mix(canon::mix(canon::op_id<Op>::value,
+			order_key<E1>::value), order_key<E2>::value));
+	};
+
+	namespace canon
+	{
+		// the rules below pick their case by class specialization rather than
+		// by overloads, overload resolution on large expression types dominates
+		// the compile time otherwise
+
+		template<typename E>
+		struct is_const : std::false_type {};
+		template<typename T>
+		struct is_const<exp<T, empty, constant>> : std::true_type {};
+
+		// literal or runtime constant
+		template<typename E>
+		struct is_num : std::integral_constant<bool, is_lit<E>::value || is_const<E>::value> {};
+
+		// all parameters share one type, so the type never tells two apart
+		template<typename E>
+		struct is_param : std::false_type {};
+		template<typename T>
+		struct is_param<exp<T, empty, parameter>> : std::true_type {};
+
+		// built of parameters and numbers, with at least one parameter
+		template<typename E, typename = void>
+		struct is_param_expr : is_param<E> {};
+		template<typename E>
+		struct is_param_expr<exp<E, empty, negate>> : is_param_expr<E> {};
+		template<typename E1, typename E2, typename Op>
+		struct is_param_expr<exp<E1, E2, Op>, std::enable_if_t<is_binary_op<Op>::value>>
+			: std::integral_constant<bool, (is_param_expr<E1>::value || is_num<E1>::value) &&
+				(is_param_expr<E2>::value || is_num<E2>::value) &&
+				(is_param_expr<E1>::value || is_param_expr<E2>::value)> {};
+
+		template<typename E>
+		struct negative
+		{
+			typedef decltype(combine_neg(std::declval<E>())) type;
+			static constexpr type apply(const E& e)
+			{
+				return combine_neg(e);
+			}
+		};
+		template<int N>
+		struct negative<lit<N>>
+		{
+			typedef lit<-N> type;
+			static constexpr type apply(const lit<N>&)
+			{
+				return {};
+			}
+		};
+		template<typename T>
+		struct negative<exp<T, empty, constant>>
+		{
+			typedef exp<T, empty, constant> type;
+			static constexpr type apply(const type& c)
+			{
+				return {-c.v_};
+			}
+		};
+
+		// a term of a sum as coef * type, the coefficient is a literal, a constant
+		// or a parameter, which come first in a canonical product; numbers are coef * 1
+		template<typename E, typename = void>
+		struct term
+		{
+			typedef E type;
+			typedef lit<1> coef_t;
+			static constexpr coef_t coef(const E&)
+			{
+				return {};
+			}
+		};
+		template<typename E>
+		struct term<E, std::enable_if_t<is_num<E>::value>>
+		{
+			typedef lit<1> type;
+			typedef E coef_t;
+			static constexpr coef_t coef(const E& e)
+			{
+				return e;
+			}
+		};
+		template<typename C, typename E>
+		struct term<exp<C, E, mult>, std::enable_if_t<is_num<C>::value>>
+		{
+			typedef E type;
+			typedef C coef_t;
+			static constexpr coef_t coef(const exp<C, E, mult>& e)
+			{
+				return e.e1_;
+			}
+		};
+		template<typename P, typename E>
+		struct term<exp<P, E, mult>, std::enable_if_t<is_param<P>::value>>
+		{
+			typedef E type;
+			typedef P coef_t;
+			static constexpr coef_t coef(const exp<P, E, mult>& e)
+			{
+				return e.e1_;
+			}
+		};
+			//a merged parameter coefficient, which a canonical product puts last
+		template<typename E, typename C>
+		struct term<exp<E, C, mult>, std::enable_if_t<is_param_expr<C>::value && is_static<E>::value && !is_num<E>::value>>
+		{
+			typedef E type;
+			typedef C coef_t;
+			static constexpr coef_t coef(const exp<E, C, mult>& e)
+			{
+				return e.e2_;
+			}
+		};
+		template<typename A, typename B, typename E, bool Scaled>
+		struct scaled_term
+		{
+			typedef exp<exp<A, B, mult>, E, mult> type;
+			typedef lit<1> coef_t;
+			static constexpr coef_t coef(const type&)
+			{
+				return {};
+			}
+		};
+		template<typename A, typename B, typename E>
+		struct scaled_term<A, B, E, true>
+		{
+			typedef term<exp<A, B, mult>> left;
+			typedef exp<typename left::type, E, mult> type;
+			typedef typename left::coef_t coef_t;
+			static constexpr coef_t coef(const exp<exp<A, B, mult>, E, mult>& e)
+			{
+				return left::coef(e.e1_);
+			}
+		};
+		template<typename A, typename B, typename E>
+		struct term<exp<exp<A, B, mult>, E, mult>, std::enable_if_t<!is_param_expr<E>::value>>
+			: scaled_term<A, B, E, !std::is_same<typename term<exp<A, B, mult>>::coef_t, lit<1>>::value> {};
+		template<typename E>
+		struct term<exp<E, empty, negate>>
+		{
+			typedef typename term<E>::type type;
+			typedef typename negative<typename term<E>::coef_t>::type coef_t;
+			static constexpr coef_t coef(const exp<E, empty, negate>& e)
+			{
+				return negative<typename term<E>::coef_t>::apply(term<E>::coef(e.e_));
+			}
+		};
+
+		// a factor of a product as type^n
+		template<typename E>
+		struct factor
+		{
+			static constexpr int n = 1;
+			typedef E type;
+		};
+		template<typename E, int N>
+		struct factor<exp<E, pow_f<N>, func>>
+		{
+			static constexpr int n = N;
+			typedef E type;
+		};
+
+		// operands of a sum are ordered by their term, of a product by their base,
+		// so that like ones are neighbours; numbers lead
+		template<typename Op, typename E>
+		struct chain_key;
+		template<typename E>
+		struct chain_key<plus, E> : order_key<typename term<E>::type> {};
+		template<typename E>
+		struct chain_key<mult, E> : order_key<typename factor<E>::type> {};
+		template<int N>
+		struct chain_key<mult, lit<N>> : order_key<lit<1>> {};
+
+		// A and B merge into one operand
+			//terms of one type whose value the type fixes,
+			//numbers of a product unless a literal 0, which the rules remove
+		template<typename Op, typename A, typename B>
+		struct like;
+		template<typename A, typename B>
+		struct like<plus, A, B> : std::integral_constant<bool,
+			std::is_same<typename term<A>::type, typename term<B>::type>::value &&
+			is_static<typename term<A>::type>::value> {};
+		template<typename A, typename B>
+		struct like<mult, A, B> : std::integral_constant<bool,
+			(is_num<A>::value && is_num<B>::value && !is_lit_n<A, 0>::value && !is_lit_n<B, 0>::value) ||
+			(std::is_same<typename factor<A>::type, typename factor<B>::type>::value &&
+				is_static<typename factor<A>::type>::value)> {};
+
+		template<typename Op, typename A, typename B>
+		struct concat;
+
+		// c * t, built like a canonical product, so 0, 1 and -1 fold
+		template<typename C, typename T>
+		constexpr auto scale(const C& c, const T& t)
+		{
+			return concat<mult, C, T>::apply(c, t);
+		}
+
+		// t^n
+		template<int N, typename T>
+		struct power
+		{
+			static constexpr exp<T, pow_f<N>, func> apply(const T& t)
+			{
+				return {t};
+			}
+		};
+		template<typename T>
+		struct power<0, T>
+		{
+			static constexpr lit<1> apply(const T&)
+			{
+				return {};
+			}
+		};
+		template<typename T>
+		struct power<1, T>
+		{
+			static constexpr T apply(const T& t)
+			{
+				return t;
+			}
+		};
+
+		// two numbers as one, a literal and a constant or two constants at runtime
+		template<typename T>
+		constexpr T value_of(const exp<T, empty, constant>& c)
+		{
+			return c.v_;
+		}
+		template<int N>
+		constexpr int value_of(const lit<N>&)
+		{
+			return N;
+		}
+
+		template<typename Op, typename A, typename B, bool = is_num<A>::value && is_num<B>::value>
+		struct fold
+		{
+			typedef exp<std::common_type_t<typename A::type, typename B::type>, empty, constant> type;
+			static constexpr type apply(const A& a, const B& b)
+			{
+				return {std::is_same<Op, plus>::value ? value_of(a) + value_of(b) : value_of(a) * value_of(b)};
+			}
+		};
+		template<int N, int M>
+		struct fold<plus, lit<N>, lit<M>, true>
+		{
+			typedef lit<N + M> type;
+			static constexpr type apply(const lit<N>&, const lit<M>&)
+			{
+				return {};
+			}
+		};
+		template<int N, int M>
+		struct fold<mult, lit<N>, lit<M>, true>
+		{
+			typedef lit<N * M> type;
+			static constexpr type apply(const lit<N>&, const lit<M>&)
+			{
+				return {};
+			}
+		};
+
+		// coefficients with parameters stay a node, a * e + b * e is (a + b) * e
+		// whether a and b are one parameter or two
+		template<typename Op, typename A, typename B>
+		struct fold<Op, A, B, false>
+		{
+			typedef decltype(combine<Op>(std::declval<A>(), std::declval<B>())) type;
+			static constexpr type apply(const A& a, const B& b)
+			{
+				return combine<Op>(a, b);
+			}
+		};
+
+		// two like operands as one
+			//the static part is rebuilt from its type
+		template<typename Op, typename A, typename B, bool = is_num<A>::value && is_num<B>::value>
+		struct merge : fold<Op, A, B> {};
+		template<typename A, typename B>
+		struct merge<plus, A, B, false>
+		{
+			static constexpr auto apply(const A& a, const B& b)
+			{
+				typedef fold<plus, typename term<A>::coef_t, typename term<B>::coef_t> sum;
+				return scale(sum::apply(term<A>::coef(a), term<B>::coef(b)), typename term<A>::type{});
+			}
+		};
+		template<typename A, typename B>
+		struct merge<mult, A, B, false>
+		{
+			static constexpr auto apply(const A&, const B&)
+			{
+				return power<factor<A>::n + factor<B>::n, typename factor<A>::type>::apply({});
+			}
+		};
+
+		// a chain is ((t1 Op t2) Op t3) ... with rising keys,
+		// insert() puts the operand c where it belongs or merges it with its like
+		template<typename Op, typename A, typename C>
+		using insert_rule = std::integral_constant<int, like<Op, A, C>::value ? 0 :
+			(chain_key<Op, C>::value < chain_key<Op, A>::value ? 1 : 2)>;
+
+		template<typename Op, typename A, typename C, int Rule = insert_rule<Op, A, C>::value>
+		struct insert
+		{
+			static constexpr auto apply(const A& a, const C& c)
+			{
+				return combine<Op>(a, c);
+			}
+		};
+		template<typename Op, typename A, typename C>
+		struct insert<Op, A, C, 0>
+		{
+			static constexpr auto apply(const A& a, const C& c)
+			{
+				return merge<Op, A, C>::apply(a, c);
+			}
+		};
+		template<typename Op, typename A, typename C>
+		struct insert<Op, A, C, 1>
+		{
+			static constexpr auto apply(const A& a, const C& c)
+			{
+				return combine<Op>(c, a);
+			}
+		};
+
+		template<typename Op, typename L, typename R, typename C, int Rule = insert_rule<Op, R, C>::value>
+		struct insert_chain
+		{
+			static constexpr auto apply(const exp<L, R, Op>& a, const C& c)
+			{
+				return combine<Op>(a, c);
+			}
+		};
+		template<typename Op, typename L, typename R, typename C>
+		struct insert_chain<Op, L, R, C, 0>
+		{
+			static constexpr auto apply(const exp<L, R, Op>& a, const C& c)
+			{
+				return combine<Op>(a.e1_, merge<Op, R, C>::apply(a.e2_, c));
+			}
+		};
+
+		template<typename Op, typename A, typename C>
+		struct put
+		{
+			static constexpr auto apply(const A& a, const C& c)
+			{
+				return insert<Op, A, C>::apply(a, c);
+			}
+		};
+		template<typename Op, typename L, typename R, typename C>
+		struct put<Op, exp<L, R, Op>, C>
+		{
+			static constexpr auto apply(const exp<L, R, Op>& a, const C& c)
+			{
+				return insert_chain<Op, L, R, C>::apply(a, c);
+			}
+		};
+
+		template<typename Op, typename L, typename R, typename C>
+		struct insert_chain<Op, L, R, C, 1>
+		{
+			static constexpr auto apply(const exp<L, R, Op>& a, const C& c)
+			{
+				return combine<Op>(put<Op, L, C>::apply(a.e1_, c), a.e2_);
+			}
+		};
+
+		// a Op b, both canonical, b's operands go in one by one
+		template<typename Op, typename A, typename B>
+		struct concat : put<Op, A, B> {};
+		template<typename Op, typename A, typename L, typename R>
+		struct concat<Op, A, exp<L, R, Op>>
+		{
+			static constexpr auto apply(const A& a, const exp<L, R, Op>& b)
+			{
+				auto l = concat<Op, A, L>::apply(a, b.e1_);
+				return put<Op, decltype(l), R>::apply(l, b.e2_);
+			}
+		};
+
+		// negations leave products, (-a) * b is -(a * b)
+		template<typename E, typename B>
+		struct concat<mult, exp<E, empty, negate>, B>
+		{
+			static constexpr auto apply(const exp<E, empty, negate>& a, const B& b)
+			{
+				return combine_neg(concat<mult, E, B>::apply(a.e_, b));
+			}
+		};
+		template<typename E, typename L, typename R>
+		struct concat<mult, exp<E, empty, negate>, exp<L, R, mult>>
+		{
+			static constexpr auto apply(const exp<E, empty, negate>& a, const exp<L, R, mult>& b)
+			{
+				return combine_neg(concat<mult, E, exp<L, R, mult>>::apply(a.e_, b));
+			}
+		};
+		template<typename A, typename E>
+		struct concat<mult, A, exp<E, empty, negate>>
+		{
+			static constexpr auto apply(const A& a, const exp<E, empty, negate>& b)
+			{
+				return combine_neg(concat<mult, A, E>::apply(a, b.e_));
+			}
+		};
+		template<typename E, typename F>
+		struct concat<mult, exp<E, empty, negate>, exp<F, empty, negate>>
+		{
+			static constexpr auto apply(const exp<E, empty, negate>& a, const exp<F, empty, negate>& b)
+			{
+				return concat<mult, E, F>::apply(a.e_, b.e_);
+			}
+		};
+
+		// a sum has a term like c
+		template<typename A, typename C>
+		struct has_like : like<plus, A, C> {};
+		template<typename L, typename R, typename C>
+		struct has_like<exp<L, R, plus>, C>
+			: std::integral_constant<bool, like<plus, R, C>::value || has_like<L, C>::value> {};
+
+		// a - b merges with a like term of a, else stays a difference
+		template<typename A, typename B, int Rule = like<plus, A, B>::value ? 0 : (has_like<A, B>::value ? 1 : 2)>
+		struct difference
+		{
+			static constexpr auto apply(const A& a, const B& b)
+			{
+				return combine<minus>(a, b);
+			}
+		};
+		template<typename A, typename B>
+		struct difference<A, B, 0>
+		{
+			static constexpr auto apply(const A& a, const B& b)
+			{
+				typedef negative<typename term<B>::coef_t> neg;
+				typedef fold<plus, typename term<A>::coef_t, typename neg::type> sum;
+				return scale(sum::apply(term<A>::coef(a), neg::apply(term<B>::coef(b))), typename term<A>::type{});
+			}
+		};
+		template<typename A, typename B>
+		struct difference<A, B, 1>
+		{
+			static constexpr auto apply(const A& a, const B& b)
+			{
+				auto n = combine_neg(b);
+				return put<plus, A, decltype(n)>::apply(a, n);
+			}
+		};
+
+		template<typename A, typename B, bool = std::is_same<A, B>::value && is_static<A>::value>
+		struct quotient
+		{
+			static constexpr auto apply(const A& a, const B& b)
+			{
+				return combine<div>(a, b);
+			}
+		};
+		template<typename A, typename B>
+		struct quotient<A, B, true>
+		{
+			static constexpr lit<1> apply(const A&, const B&)
+			{
+				return {};
+			}
+		};
+
+		// the pass, bottom-up like smp<>
+		//
+		template<typename E, typename = void>
+		struct pass
+		{
+			static constexpr E apply(const E& e)
+			{
+				return e;
+			}
+		};
+
+		template<typename E1, typename E2, typename Op>
+		struct pass<exp<E1, E2, Op>, std::enable_if_t<std::is_same<Op, plus>::value || std::is_same<Op, mult>::value>>
+		{
+			static constexpr auto apply(const exp<E1, E2, Op>& e)
+			{
+				auto a = pass<E1>::apply(e.e1_);
+				auto b = pass<E2>::apply(e.e2_);
+				return concat<Op, decltype(a), decltype(b)>::apply(a, b);
+			}
+		};
+
+		template<typename E1, typename E2>
+		struct pass<exp<E1, E2, minus>>
+		{
+			static constexpr auto apply(const exp<E1, E2, minus>& e)
+			{
+				auto a = pass<E1>::apply(e.e1_);
+				auto b = pass<E2>::apply(e.e2_);
+				return difference<decltype(a), decltype(b)>::apply(a, b);
+			}
+		};
+
+		template<typename E1, typename E2>
+		struct pass<exp<E1, E2, div>>
+		{
+			static constexpr auto apply(const exp<E1, E2, div>& e)
+			{
+				auto a = pass<E1>::apply(e.e1_);
+				auto b = pass<E2>::apply(e.e2_);
+				return quotient<decltype(a), decltype(b)>::apply(a, b);
+			}
+		};
+
+		template<typename E>
+		struct pass<exp<E, empty, negate>>
+		{
+			static constexpr auto apply(const exp<E, empty, negate>& e)
+			{
+				return combine_neg(pass<E>::apply(e.e_));
+			}
+		};
+
+		template<typename E, typename F>
+		struct pass<exp<E, F, func>>
+		{
+			static constexpr auto apply(const exp<E, F, func>& e)
+			{
+				auto s = pass<E>::apply(e.e_);
+				return exp<decltype(s), F, func>{s};
+			}
+		};
+		template<typename E, std::size_t D, typename C>
+		struct pass<exp<E, poly_f<D, C>, func>>
+		{
+			static constexpr auto apply(const exp<E, poly_f<D, C>, func>& e)
+			{
+				auto s = pass<E>::apply(e.e_);
+				return exp<decltype(s), poly_f<D, C>, func>{s, e.f_};
+			}
+		};
+		template<typename E, int N>
+		struct pass<exp<E, pow_f<N>, func>>
+		{
+			static constexpr auto apply(const exp<E, pow_f<N>, func>& e)
+			{
+				auto s = pass<E>::apply(e.e_);
+				return power<N, decltype(s)>::apply(s);
+			}
+		};
+	}
+
+	// canonical form of an expression type, on top of the simplify() rules:
+	// sums and products become left-leaning chains sorted by order_key<>, so
+	// b + a and a + b are one type, and like operands merge: terms whose
+	// value the type fixes (is_static<>) add up their coefficients,
+	// e + 2 * e into 3 * e, e - e into 0, a * e + b * e into (a + b) * e
+	// for parameters a and b, factors their powers, e * e into e^2,
+	// e / e into 1, and the numbers of a chain fold into one.
+	// Repeats no longer add a level of nesting each, which keeps the types of
+	// higher derivatives small. Reordering may change rounding in the last bit.
+	template<typename E>
+	constexpr auto canonical(const E& e)
+	{
+		return canon::pass<E>::apply(e);
+	}
+}
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef H_9BE06CCAE1E74A4ABC30DFF5B20A5ED6
+#define H_9BE06CCAE1E74A4ABC30DFF5B20A5ED6
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "batch.h"
+
+namespace metamath
+{
+	template<typename T>
+	struct table_options
+	{
+		T abs_tol_ = 0;
+		T rel_tol_ = 16 * std::numeric_limits<T>::epsilon(); //relative to max |f| on the interval
+		int max_depth_ = 12; //halvings of the interval, accepted as is below that
+	};
+
+	// piecewise polynomial replacement of an expression on [a, b]
+	// segments come from halving [a, b], every one holds the Chebyshev fit of
+	// degree N, converted to powers of t = (x - mid) / half for Horner's scheme.
+	// A table indexed at the finest segment width finds the segment of x,
+	// so an evaluation is one lookup plus N multiply-adds.
+	// Points outside [a, b] use the first or last segment.
+	template<typename T, std::size_t N = 12>
+	struct piecewise
+	{
+		static_assert(N > 0, "degree of at least 1");
+
+		typedef T type;
+		static constexpr std::size_t degree = N;
+		static constexpr std::size_t stride = N + 3;
+
+		T a_ = 0;
+		T b_ = 0;
+		T cells_ = 0; //finest segments per unit of x
+		T last_ = 0;  //index_.size() - 1
+		std::vector<std::uint32_t> index_; //finest segment -> offset into c_
+			//per segment: mid, 1 / half width, coefficients of t^0 .. t^N
+		std::vector<T> c_;
+		T err_ = 0; //largest error found at the check points
+
+		std::size_t size() const
+		{
+			return c_.size() / stride;
+		}
+
+		T operator()(T v) const
+		{
+			const T* s = &c_[find(v)];
+			const T t = (v - s[0]) * s[1];
+			T r = s[N + 2];
+			for (std::size_t k = N; k-- > 0;)
+				r = r * t + s[k + 2];
+			return r;
+		}
+			//Horner steps run lane-wise on the coefficients of each lane's segment,
+			//which are loaded once for the block when all lanes share it (sorted input)
+		template<std::size_t L>
+		simd::pack<T, L> operator()(const simd::pack<T, L>& v) const
+		{
+			std::uint32_t o[L];
+			T t[L];
+			for (std::size_t i = 0; i < L; ++i)
+				o[i] = find(v.v_[i]);
+			std::uint32_t diff = 0;
+			for (std::size_t i = 0; i < L; ++i)
+				diff |= o[i] ^ o[0];
+			for (std::size_t i = 0; i < L; ++i)
+				t[i] = (v.v_[i] - c_[o[i]]) * c_[o[i] + 1];
+
+			simd::pack<T, L> r;
+			if (diff == 0) {
+				const T* s = &c_[o[0] + 2];
+				for (std::size_t i = 0; i < L; ++i) {
+					T a = s[N];
+					for (std::size_t k = N; k-- > 0;)
+						a = a * t[i] + s[k];
+					r.v_[i] = a;
+				}
+				return r;
+			}
+
+			T c[N + 1][L];
+			for (std::size_t i = 0; i < L; ++i) {
+				for (std::size_t k = 0; k <= N; ++k)
+					c[k][i] = c_[o[i] + k + 2];
+			}
+			for (std::size_t i = 0; i < L; ++i) {
+				T a = c[N][i];
+				for (std::size_t k = N; k-- > 0;)
+					a = a * t[i] + c[k][i];
+				r.v_[i] = a;
+			}
+			return r;
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << "piecewise<" << N << ">[" << a_ << ", " << b_ << "](x)";
+			return os;
+		}
+
+	private:
+		std::uint32_t find(T v) const
+		{
+			T u = (v - a_) * cells_;
+			u = u > 0 ? u : T(0); //also NaN
+			u = u < last_ ? u : last_;
+			return index_[static_cast<std::uint32_t>(u)];
+		}
+	};
+
+	namespace cheb
+	{
+		// Chebyshev nodes of degree N on [-1, 1]
+		template<std::size_t N>
+		double node(std::size_t k)
+		{
+			return std::cos(3.14159265358979323846 * (k + 0.5) / (N + 1));
+		}
+		// the extrema of T_N+1, between the nodes and at -1, 1
+		template<std::size_t N>
+		double extremum(std::size_t k)
+		{
+			return std::cos(3.14159265358979323846 * k / (N + 1));
+		}
+
+		// c(T_0 .. T_N) from the values at the nodes, as powers of t
+		template<std::size_t N>
+		void fit(const double* f, double* p)
+		{
+			const double pi = 3.14159265358979323846;
+			double c[N + 1];
+			for (std::size_t j = 0; j <= N; ++j) {
+				double s = 0;
+				for (std::size_t k = 0; k <= N; ++k)
+					s += f[k] * std::cos(pi * j * (k + 0.5) / (N + 1));
+				c[j] = s * (j ? 2.0 : 1.0) / (N + 1);
+			}
+				// T_j+1 = 2 t T_j - T_j-1
+			double t0[N + 1] = {1};
+			double t1[N + 1] = {0, 1};
+			for (std::size_t i = 0; i <= N; ++i)
+				p[i] = c[0] * t0[i] + (N ? c[1] * t1[i] : 0);
+			for (std::size_t j = 2; j <= N; ++j) {
+				double t2[N + 1];
+				t2[0] = -t0[0];
+				for (std::size_t i = 1; i <= N; ++i)
+					t2[i] = 2 * t1[i - 1] - t0[i];
+				for (std::size_t i = 0; i <= N; ++i) {
+					p[i] += c[j] * t2[i];
+					t0[i] = t1[i];
+					t1[i] = t2[i];
+				}
+			}
+		}
+	}
+
+	// fits e on [a, b] to the tolerance of o
+	// segments are refined in rounds like integrate(): the nodes and check
+	// points of all open segments go through one evaluate() call, then each
+	// segment is accepted or halved. The check points lie between the nodes
+	// and at the ends, where the error of the fit peaks.
+	template<std::size_t N = 12, typename E, typename T>
+	piecewise<T, N> tabulate(const E& e, T a, T b, const table_options<T>& o = {})
+	{
+		typedef piecewise<T, N> table_t;
+		constexpr std::size_t S = table_t::stride;
+		constexpr std::size_t checks = N + 2;
+		constexpr std::size_t per = N + 1 + checks;
+		using std::abs;
+
+		struct open_t
+		{
+			std::uint32_t pos_; //position among the segments of its depth
+			int depth_;
+		};
+		struct done_t
+		{
+			T s_[S];
+			std::uint32_t pos_;
+			int depth_;
+		};
+
+		table_t r;
+		r.a_ = a;
+		r.b_ = b;
+
+		std::vector<open_t> open{{0, 0}};
+		std::vector<open_t> next;
+		std::vector<done_t> done;
+		std::vector<T> xs;
+		std::vector<T> fs;
+		T tol = 0;
+		int depth = 0;
+
+		while (!open.empty()) {
+			xs.resize(open.size() * per);
+			fs.resize(xs.size());
+			for (std::size_t i = 0; i < open.size(); ++i) {
+				const T w = (b - a) / static_cast<T>(std::uint32_t(1) << open[i].depth_);
+				const T l = a + w * static_cast<T>(open[i].pos_);
+				T* q = &xs[i * per];
+				for (std::size_t k = 0; k <= N; ++k)
+					q[k] = l + w * static_cast<T>((cheb::node<N>(k) + 1) / 2);
+				for (std::size_t k = 0; k < checks; ++k)
+					q[N + 1 + k] = l + w * static_cast<T>((cheb::extremum<N>(k) + 1) / 2);
+			}
+
+			evaluate(e, xs.data(), fs.data(), xs.size());
+
+			if (open[0].depth_ == 0) {
+				T m = 0;
+				for (std::size_t k = 0; k < per; ++k)
+					m = abs(fs[k]) > m ? abs(fs[k]) : m;
+				tol = o.abs_tol_ > o.rel_tol_ * m ? o.abs_tol_ : o.rel_tol_ * m;
+			}
+
+			next.clear();
+			for (std::size_t i = 0; i < open.size(); ++i) {
+				const open_t& sg = open[i];
+				const T* q = &xs[i * per];
+				const T* f = &fs[i * per];
+				const T w = (b - a) / static_cast<T>(std::uint32_t(1) << sg.depth_);
+
+				done_t d;
+				d.pos_ = sg.pos_;
+				d.depth_ = sg.depth_;
+				d.s_[0] = a + w * (static_cast<T>(sg.pos_) + T(0.5));
+				d.s_[1] = 2 / w;
+
+				double fd[N + 1];
+				double p[N + 1];
+				for (std::size_t k = 0; k <= N; ++k)
+					fd[k] = static_cast<double>(f[k]);
+				cheb::fit<N>(fd, p);
+				for (std::size_t k = 0; k <= N; ++k)
+					d.s_[k + 2] = static_cast<T>(p[k]);
+
+				T err = 0;
+				for (std::size_t k = 0; k < checks; ++k) {
+					const T t = (q[N + 1 + k] - d.s_[0]) * d.s_[1];
+					T v = d.s_[N + 2];
+					for (std::size_t j = N; j-- > 0;)
+						v = v * t + d.s_[j + 2];
+					const T ek = abs(v - f[N + 1 + k]);
+					err = ek > err || ek != ek ? ek : err;
+				}
+
+				if (err <= tol || sg.depth_ >= o.max_depth_) {
+					r.err_ = err > r.err_ || err != err ? err : r.err_;
+					depth = sg.depth_ > depth ? sg.depth_ : depth;
+					done.push_back(d);
+				}
+				else {
+					next.push_back({2 * sg.pos_, sg.depth_ + 1});
+					next.push_back({2 * sg.pos_ + 1, sg.depth_ + 1});
+				}
+			}
+			open.swap(next);
+		}
+
+		const std::uint32_t cells = std::uint32_t(1) << depth;
+		r.cells_ = static_cast<T>(cells) / (b - a);
+		r.last_ = static_cast<T>(cells - 1);
+		r.index_.resize(cells);
+		r.c_.reserve(done.size() * S);
+		for (const done_t& d : done) {
+			const std::uint32_t k = static_cast<std::uint32_t>(r.c_.size());
+			const int sh = depth - d.depth_;
+			for (std::uint32_t c = d.pos_ << sh; c < (d.pos_ + 1) << sh; ++c)
+				r.index_[c] = k;
+			r.c_.insert(r.c_.end(), d.s_, d.s_ + S);
+		}
+		return r;
+	}
+}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef H_09BACE897249473DBED47C01BA2B27D1
+#define H_09BACE897249473DBED47C01BA2B27D1
+
+#include <assert.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <utility>
+#include "tape.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#include <unistd.h>
+#define METAMATH_NATIVE 1
+#endif
+
+namespace metamath
+{
+	// C names of an evaluation type
+	template<typename T>
+	struct c_type;
+
+	template<>
+	struct c_type<float>
+	{
+		static const char* name() { return "float"; }
+		static const char* suffix() { return "f"; } //of math.h functions and literals
+	};
+	template<>
+	struct c_type<double>
+	{
+		static const char* name() { return "double"; }
+		static const char* suffix() { return ""; }
+	};
+
+	// C source for tapes, every tape added as name gives
+	//   T name(const T* v)                                   v[i] is the value of variable i
+	//   void name_batch(const T* const* in, T* out, size_t n)  out[k] = name(in[0][k], in[1][k], ...)
+	// the code is straight-line, shared subexpressions are computed once into temporaries
+	template<typename T>
+	struct c_source
+	{
+		typedef c_type<T> ct;
+
+		std::ostringstream os_;
+
+		c_source()
+		{
+			const char* t = ct::name();
+			os_ << "/* generated by metamath */\n"
+				<< "#include <math.h>\n"
+				<< "#include <stddef.h>\n\n"
+				<< "static inline " << t << " mm_powi(" << t << " v, int n)\n"
+				<< "{\n"
+				<< "\tunsigned k = n < 0 ? 0u - (unsigned)n : (unsigned)n;\n"
+				<< "\t" << t << " r = 1;\n"
+				<< "\tfor (; k; k >>= 1, v *= v)\n"
+				<< "\t\tif (k & 1)\n"
+				<< "\t\t\tr *= v;\n"
+				<< "\treturn n < 0 ? 1 / r : r;\n"
+				<< "}\n";
+		}
+
+		void add(const std::string& name, const tape<T>& t)
+		{
+			const char* tn = ct::name();
+
+			os_ << "\n" << tn << " " << name << "(const " << tn << "* v)\n{\n";
+			body(t, "\t", "v[", "]");
+			os_ << "\treturn r" << t.out_ << ";\n}\n";
+
+			os_ << "\nvoid " << name << "_batch(const " << tn << "* const* in, " << tn << "* restrict out, size_t n)\n{\n"
+				<< "\tfor (size_t i = 0; i < n; ++i) {\n";
+			body(t, "\t\t", "in[", "][i]");
+			os_ << "\t\tout[i] = r" << t.out_ << ";\n\t}\n}\n";
+		}
+
+		std::string str() const
+		{
+			return os_.str();
+		}
+
+	private:
+		void constant(T v)
+		{
+			if (std::isnan(v)) {
+				os_ << "NAN";
+				return;
+			}
+			if (std::isinf(v)) {
+				os_ << (v < 0 ? "(-INFINITY)" : "INFINITY"); //math.h, %a would print inf
+				return;
+			}
+			char buf[64];
+			std::snprintf(buf, sizeof(buf), "%a", static_cast<double>(v)); //exact
+			os_ << buf << ct::suffix();
+		}
+
+		void body(const tape<T>& t, const char* indent, const char* in, const char* in_end)
+		{
+			using vm::op;
+
+			os_ << indent << ct::name();
+			for (std::uint32_t r = 0; r < t.regs_; ++r)
+				os_ << (r ? ", r" : " r") << r;
+			os_ << ";\n";
+
+			const char* s = ct::suffix();
+			for (const vm::instr& c : t.code_) {
+				os_ << indent << "r" << c.dst_ << " = ";
+				switch (c.op_) {
+				case op::cnst: constant(t.consts_[c.a_]); break;
+				case op::var: os_ << in << c.a_ << in_end; break;
+				case op::add: os_ << "r" << c.a_ << " + r" << c.b_; break;
+				case op::sub: os_ << "r" << c.a_ << " - r" << c.b_; break;
+				case op::mul: os_ << "r" << c.a_ << " * r" << c.b_; break;
+				case op::div: os_ << "r" << c.a_ << " / r" << c.b_; break;
+				case op::neg: os_ << "-r" << c.a_; break;
+				case op::sin: os_ << "sin" << s << "(r" << c.a_ << ")"; break;
+				case op::cos: os_ << "cos" << s << "(r" << c.a_ << ")"; break;
+				case op::sqrt: os_ << "sqrt" << s << "(r" << c.a_ << ")"; break;
+				case op::exp: os_ << "exp" << s << "(r" << c.a_ << ")"; break;
+				case op::ln: os_ << "log" << s << "(r" << c.a_ << ")"; break;
+				case op::abs: os_ << "fabs" << s << "(r" << c.a_ << ")"; break;
+				case op::pow: os_ << "mm_powi(r" << c.a_ << ", " << static_cast<std::int32_t>(c.b_) << ")"; break;
+				}
+				os_ << ";\n";
+			}
+		}
+	};
+
+	// source of a single function, e.g. codegen(compile(f), "f")
+	template<typename T>
+	std::string codegen(const tape<T>& t, const std::string& name)
+	{
+		c_source<T> src;
+		src.add(name, t);
+		return src.str();
+	}
+
+#ifdef METAMATH_NATIVE
+	// a shared library built from generated source and loaded with dlopen
+	// (link with -ldl where dlopen is not part of libc)
+	struct native_module
+	{
+		void* h_ = nullptr;
+
+		native_module() = default;
+		explicit native_module(void* h)
+			:h_{h}
+		{
+		}
+		native_module(native_module&& m)
+			:h_{m.h_}
+		{
+			m.h_ = nullptr;
+		}
+		native_module& operator=(native_module&& m)
+		{
+			std::swap(h_, m.h_);
+			return *this;
+		}
+		~native_module()
+		{
+			if (h_)
+				dlclose(h_);
+		}
+
+		explicit operator bool() const
+		{
+			return h_ != nullptr;
+		}
+
+		template<typename F>
+		F* get(const std::string& name) const
+		{
+			return h_ ? reinterpret_cast<F*>(dlsym(h_, name.c_str())) : nullptr;
+		}
+	};
+
+	// compiles C source with $CC (cc by default) and loads it,
+	// an empty module if either step fails
+	inline native_module build(const std::string& source, const char* flags = "-O3")
+	{
+		const char* tmp = std::getenv("TMPDIR");
+		std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/metamathXXXXXX";
+		if (!mkdtemp(&dir[0]))
+			return {};
+
+		const std::string src = dir + "/m.c";
+		const std::string lib = dir + "/m.so";
+
+		void* h = nullptr;
+		if (FILE* f = std::fopen(src.c_str(), "w")) {
+			const bool ok = std::fwrite(source.data(), 1, source.size(), f) == source.size();
+			std::fclose(f);
+
+			const char* cc = std::getenv("CC");
+			std::string cmd = std::string(cc && *cc ? cc : "cc") + " " + flags
+				+ " -std=c99 -shared -fPIC -o '" + lib + "' '" + src + "' -lm";
+			if (ok && std::system(cmd.c_str()) == 0)
+				h = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+		}
+
+		unlink(src.c_str());
+		unlink(lib.c_str());
+		rmdir(dir.c_str());
+		return native_module{h};
+	}
+
+	// a tape compiled to native code
+	template<typename T>
+	struct native_function
+	{
+		native_module m_;
+		T (*f_)(const T*) = nullptr;
+		void (*batch_)(const T* const*, T*, std::size_t) = nullptr;
+		std::uint32_t vars_ = 0; //variables read
+
+		explicit operator bool() const
+		{
+			return f_ != nullptr && batch_ != nullptr;
+		}
+
+		// as for a tape, a value for every variable
+		T operator()(T v) const
+		{
+			assert(vars_ <= 1 && "the function reads more than one variable");
+			return f_(&v);
+		}
+		template<std::size_t N>
+		T operator()(const point<T, N>& p) const
+		{
+			assert(vars_ <= N && "no value for a variable of the function");
+			return f_(p.v_);
+		}
+	};
+
+	template<typename T>
+	native_function<T> compile_native(const tape<T>& t, const char* flags = "-O3")
+	{
+		native_function<T> r;
+		r.m_ = build(codegen(t, "mm_f"), flags);
+		r.f_ = r.m_.template get<T(const T*)>("mm_f");
+		r.batch_ = r.m_.template get<void(const T* const*, T*, std::size_t)>("mm_f_batch");
+		r.vars_ = t.vars_;
+		return r;
+	}
+
+	template<typename T>
+	void evaluate(const native_function<T>& f, const T* const* in, T* out, std::size_t n)
+	{
+		f.batch_(in, out, n);
+	}
+	template<typename T>
+	void evaluate(const native_function<T>& f, const T* in, T* out, std::size_t n)
+	{
+		assert(f.vars_ <= 1 && "the function reads more than one variable");
+		f.batch_(&in, out, n);
+	}
+#endif
+}
+
+#endif
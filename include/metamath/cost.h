@@ -0,0 +1,198 @@
+#ifndef H_7B0875D3B7B04C0DA1164647B90ECEF3
+#define H_7B0875D3B7B04C0DA1164647B90ECEF3
+
+#include <type_traits>
+#include "func.h"
+
+namespace metamath
+{
+	// cost of evaluating an expression type once, known at compile time
+	//
+	//   nodes  - nodes of the tree, leaves included
+	//   depth  - longest path from the root to a leaf
+	//   adds   - additions and subtractions
+	//   mults  - multiplications, also the ones of Pow<N> and of divisions
+	//            by a constant (multiplied by the reciprocal)
+	//   divs   - divisions
+	//   negs   - negations
+	//   calls  - sin, cos, exp, ln, sqrt and user functions; abs is a sign
+	//            bit and not counted
+	//
+	// the tree is counted as it is evaluated: a subexpression used twice
+	// costs twice, a subexpression without variables is computed on scalars
+	// (once per call, hoisted out of loops) and counts as a leaf
+	template<typename E>
+	struct cost;
+
+	namespace costs
+	{
+		// variables, constants and literals
+		struct leaf
+		{
+			static constexpr int nodes = 1;
+			static constexpr int depth = 1;
+			static constexpr int adds = 0;
+			static constexpr int mults = 0;
+			static constexpr int divs = 0;
+			static constexpr int negs = 0;
+			static constexpr int calls = 0;
+		};
+		// the missing operand of unary nodes
+		struct none
+		{
+			static constexpr int nodes = 0;
+			static constexpr int depth = 0;
+			static constexpr int adds = 0;
+			static constexpr int mults = 0;
+			static constexpr int divs = 0;
+			static constexpr int negs = 0;
+			static constexpr int calls = 0;
+		};
+
+		// a node over the operands A and B
+		template<typename A, typename B, int Adds, int Mults, int Divs, int Negs, int Calls>
+		struct node
+		{
+			static constexpr int nodes = A::nodes + B::nodes + 1;
+			static constexpr int depth = (A::depth > B::depth ? A::depth : B::depth) + 1;
+			static constexpr int adds = A::adds + B::adds + Adds;
+			static constexpr int mults = A::mults + B::mults + Mults;
+			static constexpr int divs = A::divs + B::divs + Divs;
+			static constexpr int negs = A::negs + B::negs + Negs;
+			static constexpr int calls = A::calls + B::calls + Calls;
+		};
+
+		// multiplications of ipow<N>
+		constexpr int pow_mults(int n)
+		{
+			return n <= 1 ? 0 : pow_mults(n / 2) + 1 + n % 2;
+		}
+
+		// the work of a function itself
+		template<typename F>
+		struct function
+		{
+			static constexpr int mults = 0;
+			static constexpr int divs = 0;
+			static constexpr int calls = 1;
+		};
+		template<>
+		struct function<abs_f>
+		{
+			static constexpr int mults = 0;
+			static constexpr int divs = 0;
+			static constexpr int calls = 0;
+		};
+		template<int N>
+		struct function<pow_f<N>>
+		{
+			static constexpr int mults = pow_mults(N < 0 ? -N : N);
+			static constexpr int divs = N < 0 ? 1 : 0;
+			static constexpr int calls = 0;
+		};
+
+		template<typename E>
+		struct has_var : std::false_type {};
+		template<typename T, typename Tag>
+		struct has_var<exp<T, Tag, variable>> : std::true_type {};
+		template<typename E, typename F>
+		struct has_var<exp<E, F, func>> : has_var<E> {};
+		template<typename E>
+		struct has_var<exp<E, empty, negate>> : has_var<E> {};
+		template<typename E1, typename E2, typename Op>
+		struct has_var<exp<E1, E2, Op>>
+			: std::integral_constant<bool, has_var<E1>::value || has_var<E2>::value> {};
+
+		template<typename E>
+		struct of : leaf {};
+
+		template<typename E, typename F>
+		struct of<exp<E, F, func>>
+			:node<cost<E>, none, 0, function<F>::mults, function<F>::divs, 0, function<F>::calls>
+		{
+		};
+		// Horner's scheme
+		template<typename E, std::size_t D, typename C>
+		struct of<exp<E, poly_f<D, C>, func>>
+			:node<cost<E>, none, static_cast<int>(D), static_cast<int>(D), 0, 0, 0>
+		{
+		};
+		template<typename E1, typename E2>
+		struct of<exp<E1, E2, plus>>
+			:node<cost<E1>, cost<E2>, 1, 0, 0, 0, 0>
+		{
+		};
+		template<typename E1, typename E2>
+		struct of<exp<E1, E2, minus>>
+			:node<cost<E1>, cost<E2>, 1, 0, 0, 0, 0>
+		{
+		};
+		template<typename E1, typename E2>
+		struct of<exp<E1, E2, mult>>
+			:node<cost<E1>, cost<E2>, 0, 1, 0, 0, 0>
+		{
+		};
+		template<typename E1, typename E2>
+		struct of<exp<E1, E2, div>>
+			:node<cost<E1>, cost<E2>, 0, 0, 1, 0, 0>
+		{
+		};
+		template<typename E1, typename T>
+		struct of<exp<E1, exp<T, empty, constant>, div>>
+			:node<cost<E1>, leaf, 0, 1, 0, 0, 0>
+		{
+		};
+		template<typename E1, int N>
+		struct of<exp<E1, lit<N>, div>>
+			:node<cost<E1>, leaf, 0, 1, 0, 0, 0>
+		{
+		};
+		template<typename E>
+		struct of<exp<E, empty, negate>>
+			:node<cost<E>, none, 0, 0, 0, 1, 0>
+		{
+		};
+	}
+
+	template<typename E>
+	struct cost
+		:std::conditional_t<costs::has_var<E>::value, costs::of<E>, costs::leaf>
+	{
+	};
+
+	// the cost of e as a value, to print or compare
+	struct cost_info
+	{
+		int nodes_;
+		int depth_;
+		int adds_;
+		int mults_;
+		int divs_;
+		int negs_;
+		int calls_;
+
+		// all arithmetic operations and calls
+		constexpr int ops() const
+		{
+			return adds_ + mults_ + divs_ + negs_ + calls_;
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << "nodes " << nodes_ << ", depth " << depth_ << ", adds " << adds_
+				<< ", mults " << mults_ << ", divs " << divs_ << ", negs " << negs_
+				<< ", calls " << calls_;
+			return os;
+		}
+	};
+
+	template<typename E>
+	constexpr cost_info cost_of(const E&)
+	{
+		typedef cost<E> c;
+		return {c::nodes, c::depth, c::adds, c::mults, c::divs, c::negs, c::calls};
+	}
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef H_CD8E834045D249EAB65319863364FA09
+#define H_CD8E834045D249EAB65319863364FA09
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// true while the compiler evaluates a constant expression
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define METAMATH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#elif defined(_MSC_VER) && _MSC_VER >= 1925
+#define METAMATH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+namespace metamath
+{
+	// constexpr versions of the <cmath> functions used by func.h
+	// in constant expressions the series below are evaluated (in long double),
+	// at runtime the calls go to std::, so results and speed do not change.
+	// Without a way to tell the two apart (no __builtin_is_constant_evaluated),
+	// the std:: functions are used, which gcc can still fold at compile time.
+	namespace cx
+	{
+		typedef long double work;
+
+		static constexpr work ln2 = 0.693147180559945309417232121458176568L;
+		static constexpr work pio2 = 1.57079632679489661923132169163975144L;
+		static constexpr work pio2_1 = 1.570796326734125614166259765625L; //pi / 2 in 3 parts of 32 bits,
+		static constexpr work pio2_2 = 6.077100506303965976595549136618501506745815277099609375e-11L; //k * part is exact
+		static constexpr work pio2_3 = 2.0222662487959507323996846200947577e-21L;
+
+		constexpr work nan_w()
+		{
+			return std::numeric_limits<work>::quiet_NaN();
+		}
+		constexpr work inf_w()
+		{
+			return std::numeric_limits<work>::infinity();
+		}
+
+		// sum of the terms t_k until they no longer change s
+		constexpr work exp_w(work v)
+		{
+			if (v != v)
+				return v;
+			if (v > 12000)
+				return inf_w();
+			if (v < -12000)
+				return 0;
+				// v = k ln2 + r, |r| <= ln2 / 2
+			const long long k = static_cast<long long>(v / ln2 + (v < 0 ? -0.5L : 0.5L));
+			const work r = v - k * ln2;
+			work s = 1;
+			work t = 1;
+			for (int i = 1; i < 40; ++i) {
+				t = t * r / i;
+				if (s + t == s)
+					break;
+				s += t;
+			}
+			for (long long i = 0; i < k; ++i)
+				s *= 2;
+			for (long long i = 0; i > k; --i)
+				s /= 2;
+			return s;
+		}
+
+		// ln(m 2^e) = 2 atanh((m - 1) / (m + 1)) + e ln2
+		constexpr work log_w(work v)
+		{
+			if (!(v >= 0))
+				return nan_w();
+			if (v == 0)
+				return -inf_w();
+			if (v == inf_w())
+				return v;
+			long e = 0;
+			for (; v >= 2; ++e)
+				v /= 2;
+			for (; v < 1; --e)
+				v *= 2;
+			if (v > 1.41421356237309504880L) {
+				v /= 2;
+				++e;
+			}
+			const work t = (v - 1) / (v + 1);
+			const work t2 = t * t;
+			work s = t;
+			work p = t;
+			for (int i = 3; i < 200; i += 2) {
+				p *= t2;
+				if (s + p / i == s)
+					break;
+				s += p / i;
+			}
+			return 2 * s + e * ln2;
+		}
+
+		// Newton steps on m in [1, 4), scaled back by 2^e
+		constexpr work sqrt_w(work v)
+		{
+			if (!(v >= 0))
+				return nan_w();
+			if (v == 0 || v == inf_w())
+				return v;
+			work f = 1;
+			for (; v >= 4; f *= 2)
+				v /= 4;
+			for (; v < 1; f /= 2)
+				v *= 4;
+			work r = (1 + v) / 2;
+			for (int i = 0; i < 8; ++i)
+				r = (r + v / r) / 2;
+			return r * f;
+		}
+
+		// sin(v) for q = 0, cos(v) for q = 1
+		// the reduction by pi / 2 is accurate for |v| < 2^31
+		constexpr work sin_w(work v, int q)
+		{
+			if (v != v || v == inf_w() || v == -inf_w())
+				return nan_w();
+			const long long k = static_cast<long long>(v / pio2 + (v < 0 ? -0.5L : 0.5L));
+			const work r = ((v - k * pio2_1) - k * pio2_2) - k * pio2_3;
+			const work r2 = r * r;
+			work s = r;
+			work c = 1;
+			work ts = r;
+			work tc = 1;
+			for (int i = 1; i < 20; ++i) {
+				ts = -ts * r2 / ((2 * i) * (2 * i + 1));
+				tc = -tc * r2 / ((2 * i - 1) * (2 * i));
+				s += ts;
+				c += tc;
+			}
+			const long long j = ((k + q) % 4 + 4) % 4;
+			return j == 0 ? s : (j == 1 ? c : (j == 2 ? -s : -c));
+		}
+
+		// integer arguments give double, like the std:: overloads
+		template<typename T>
+		using real_t = std::enable_if_t<std::is_arithmetic<T>::value,
+			std::conditional_t<std::is_integral<T>::value, double, T>>;
+
+#if defined(METAMATH_CONSTANT_EVALUATED)
+#define METAMATH_CX_FUNC(NAME, IMPL) \
+		template<typename T> \
+		constexpr real_t<T> NAME(T v) \
+		{ \
+			return METAMATH_CONSTANT_EVALUATED() ? static_cast<real_t<T>>(IMPL) : std::NAME(v); \
+		}
+#else
+#define METAMATH_CX_FUNC(NAME, IMPL) \
+		template<typename T> \
+		constexpr real_t<T> NAME(T v) \
+		{ \
+			return std::NAME(v); \
+		}
+#endif
+
+		METAMATH_CX_FUNC(sin, sin_w(v, 0))
+		METAMATH_CX_FUNC(cos, sin_w(v, 1))
+		METAMATH_CX_FUNC(exp, exp_w(v))
+		METAMATH_CX_FUNC(log, log_w(v))
+		METAMATH_CX_FUNC(sqrt, sqrt_w(v))
+
+#undef METAMATH_CX_FUNC
+
+		template<typename T>
+		constexpr std::enable_if_t<std::is_integral<T>::value, T> abs(T v)
+		{
+			return v < 0 ? -v : v;
+		}
+		template<typename T>
+		constexpr std::enable_if_t<std::is_floating_point<T>::value, T> abs(T v)
+		{
+#if defined(METAMATH_CONSTANT_EVALUATED)
+			return METAMATH_CONSTANT_EVALUATED() ? (v < 0 ? -v : v + T(0)) : std::abs(v); //+0 for -0
+#else
+			return std::abs(v);
+#endif
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,589 @@
+#ifndef H_E516983403BA4FFF929F98D846675CE3
+#define H_E516983403BA4FFF929F98D846675CE3
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tape.h"
+
+namespace metamath
+{
+	// bump allocator, objects live as long as the arena
+	template<typename N, std::size_t Chunk = 1024>
+	struct arena
+	{
+		std::vector<std::unique_ptr<N[]>> chunks_;
+		std::size_t used_ = Chunk; //objects taken from the last chunk
+
+		N* alloc()
+		{
+			if (used_ == Chunk) {
+				chunks_.emplace_back(new N[Chunk]);
+				used_ = 0;
+			}
+			return &chunks_[chunks_.size() - 1][used_++];
+		}
+
+		std::size_t size() const
+		{
+			return chunks_.empty() ? 0 : (chunks_.size() - 1) * Chunk + used_;
+		}
+	};
+
+	// runtime expression graph
+	// nodes are hash-consed, building an expression that is already in the
+	// graph returns the existing node, so equal subexpressions are shared
+	template<typename T = domain>
+	struct dag
+	{
+		typedef T type;
+
+		struct node
+		{
+			vm::op op_;
+			std::int32_t n_;   //variable index, exponent of pow
+			std::uint32_t id_; //creation order
+			const node* a_;
+			const node* b_;
+			T v_;              //value of a constant
+
+			template<typename Os>
+			Os& print(Os& os) const
+			{
+				using vm::op;
+				switch (op_) {
+				case op::cnst: os << v_; break;
+				case op::var:
+					switch (n_) {
+					case 0: os << "x"; break;
+					case 1: os << "y"; break;
+					case 2: os << "z"; break;
+					default: os << "x" << n_; break;
+					}
+					break;
+				case op::add: os << "(" << *a_ << " + " << *b_ << ")"; break;
+				case op::sub: os << "(" << *a_ << " - " << *b_ << ")"; break;
+				case op::mul: os << *a_ << " * " << *b_; break;
+				case op::div: os << "((" << *a_ << ")" << " / " << "(" << *b_ << "))"; break;
+				case op::neg: os << "-" << *a_; break;
+				case op::sin: os << "sin(" << *a_ << ")"; break;
+				case op::cos: os << "cos(" << *a_ << ")"; break;
+				case op::sqrt: os << "sqrt(" << *a_ << ")"; break;
+				case op::exp: os << "e" << "^(" << *a_ << ")"; break;
+				case op::ln: os << "ln" << "(" << *a_ << ")"; break;
+				case op::abs: os << "|" << *a_ << "|"; break;
+				case op::pow: os << "(" << *a_ << ")^" << n_; break;
+				}
+				return os;
+			}
+		};
+		typedef const node* ref;
+
+		static_assert(sizeof(T) <= sizeof(std::uint64_t), "unsupported domain");
+
+		arena<node> nodes_;
+		std::vector<ref> table_; //open addressing, size is a power of 2
+
+		std::size_t size() const
+		{
+			return nodes_.size();
+		}
+
+		// leaves
+		//
+		ref constant(T v)
+		{
+			return make(vm::op::cnst, 0, nullptr, nullptr, v);
+		}
+		ref variable(std::uint32_t i)
+		{
+			return make(vm::op::var, static_cast<std::int32_t>(i), nullptr, nullptr, T(0));
+		}
+		template<typename D, typename Tag>
+		ref variable(const exp<D, Tag, metamath::variable>& v)
+		{
+			return variable(static_cast<std::uint32_t>(v.index));
+		}
+
+		// operations, the trivial ones are folded:
+		// constant operands, 0 + e, e - 0, 0 - e, 0 * e, 1 * e, -1 * e, c1 * (c2 * e),
+		// e / 1, 0 / e, -(-e), e^1 and e^0
+		//
+		ref emit(vm::op o, ref a, ref b)
+		{
+			using vm::op;
+
+			if (a->op_ == op::cnst && b->op_ == op::cnst)
+				return constant(fold(o, a->v_, b->v_, 0));
+
+			switch (o) {
+			case op::add:
+				if (zero(a)) return b;
+				if (zero(b)) return a;
+				break;
+			case op::sub:
+				if (zero(b)) return a;
+				if (zero(a)) return emit(op::neg, b);
+				break;
+			case op::mul:
+				if (zero(a) || zero(b)) return constant(T(0));
+				if (one(a)) return b;
+				if (one(b)) return a;
+				if (minus_one(a)) return emit(op::neg, b);
+				if (minus_one(b)) return emit(op::neg, a);
+				if (b->op_ == op::cnst)
+					std::swap(a, b);
+					// c1 * (c2 * e)
+				if (a->op_ == op::cnst && b->op_ == op::mul) {
+					if (b->a_->op_ == op::cnst)
+						return emit(op::mul, constant(a->v_ * b->a_->v_), b->b_);
+					if (b->b_->op_ == op::cnst)
+						return emit(op::mul, constant(a->v_ * b->b_->v_), b->a_);
+				}
+				break;
+			case op::div:
+				if (zero(a)) return constant(T(0));
+				if (one(b)) return a;
+				break;
+			default:
+				break;
+			}
+
+				// one order for commutative operands, constants first
+			if (vm::commutative(o)) {
+				const bool ca = a->op_ == op::cnst;
+				const bool cb = b->op_ == op::cnst;
+				if (ca != cb ? cb : b->id_ < a->id_)
+					std::swap(a, b);
+			}
+			return make(o, 0, a, b, T(0));
+		}
+		ref emit(vm::op o, ref a)
+		{
+			return emit_imm(o, a, 0);
+		}
+		// an operation with an immediate operand, the exponent of pow
+		ref emit_imm(vm::op o, ref a, std::uint32_t n)
+		{
+			using vm::op;
+
+			const std::int32_t k = o == op::pow ? static_cast<std::int32_t>(n) : 0;
+			if (a->op_ == op::cnst)
+				return constant(fold(o, a->v_, T(0), k));
+			if (o == op::neg && a->op_ == op::neg)
+				return a->a_;
+			if (o == op::pow && k == 1)
+				return a;
+			if (o == op::pow && k == 0)
+				return constant(T(1));
+			return make(o, k, a, nullptr, T(0));
+		}
+
+		// lowers a compile-time expression into the graph
+		template<typename E>
+		ref insert(const E& e)
+		{
+			return lower<E>::emit(e, *this);
+		}
+
+		// derivative by the variable with index wrt
+		// the result is built from the nodes of f, e.g. the derivative
+		// of a / b refers to the node of the quotient itself
+		ref derivative(ref f, std::uint32_t wrt = 0)
+		{
+			std::vector<ref> memo(size(), nullptr);
+			return drv(f, wrt, memo);
+		}
+		template<typename D, typename Tag>
+		ref derivative(ref f, const exp<D, Tag, metamath::variable>& v)
+		{
+			return derivative(f, static_cast<std::uint32_t>(v.index));
+		}
+
+		// the tape of a node
+		tape<T> compile(ref f) const
+		{
+			tape_builder<T> b;
+			std::vector<std::uint32_t> memo(nodes_.size(), vm::none);
+			std::uint32_t out = emit_tape(f, b, memo);
+			return b.finish(out);
+		}
+
+		// parses e.g. "4*sin(2*x) + ln(3*x)"
+		// functions: sin, cos, sqrt, exp, ln (log), abs, pow(e, n) and e^n
+		// with an integer n, variables: x, y, z, x0, x1, ...
+		// returns nullptr on a syntax error, err receives its offset
+		ref parse(const char* s, std::size_t* err = nullptr)
+		{
+			parser p{*this, s, s};
+			ref r = p.expr();
+			p.space();
+			if (r && *p.p_ == 0)
+				return r;
+			if (err)
+				*err = static_cast<std::size_t>(p.p_ - s);
+			return nullptr;
+		}
+		ref parse(const std::string& s, std::size_t* err = nullptr)
+		{
+			return parse(s.c_str(), err);
+		}
+
+	private:
+		static std::uint64_t bits(T v)
+		{
+			std::uint64_t r = 0;
+			std::memcpy(&r, &v, sizeof(T));
+			return r;
+		}
+
+		static bool zero(ref e)
+		{
+			return e->op_ == vm::op::cnst && e->v_ == T(0);
+		}
+		static bool one(ref e)
+		{
+			return e->op_ == vm::op::cnst && e->v_ == T(1);
+		}
+		static bool minus_one(ref e)
+		{
+			return e->op_ == vm::op::cnst && e->v_ == T(-1);
+		}
+
+		static T fold(vm::op o, T a, T b, std::int32_t n)
+		{
+			using vm::op;
+			using std::sin;
+			using std::cos;
+			using std::sqrt;
+			using std::exp;
+			using std::log;
+			using std::abs;
+
+			switch (o) {
+			case op::add: return a + b;
+			case op::sub: return a - b;
+			case op::mul: return a * b;
+			case op::div: return a / b;
+			case op::neg: return -a;
+			case op::sin: return sin(a);
+			case op::cos: return cos(a);
+			case op::sqrt: return sqrt(a);
+			case op::exp: return exp(a);
+			case op::ln: return log(a);
+			case op::abs: return abs(a);
+			case op::pow: return vm::powi(a, n);
+			default: return a;
+			}
+		}
+
+		static std::size_t hash(vm::op o, std::int32_t n, ref a, ref b, T v)
+		{
+			std::uint64_t h = static_cast<std::uint64_t>(o) ^ (static_cast<std::uint64_t>(static_cast<std::uint32_t>(n)) << 8);
+			h = h * 0x9E3779B97F4A7C15ull ^ (a ? a->id_ : vm::none);
+			h = h * 0x9E3779B97F4A7C15ull ^ (b ? b->id_ : vm::none);
+			h = h * 0x9E3779B97F4A7C15ull ^ bits(v);
+			return static_cast<std::size_t>(h ^ (h >> 32));
+		}
+
+		ref make(vm::op o, std::int32_t n, ref a, ref b, T v)
+		{
+			if (2 * (nodes_.size() + 1) > table_.size())
+				grow();
+
+			const std::size_t mask = table_.size() - 1;
+			std::size_t i = hash(o, n, a, b, v) & mask;
+			for (; table_[i]; i = (i + 1) & mask) {
+				ref e = table_[i];
+				if (e->op_ == o && e->n_ == n && e->a_ == a && e->b_ == b && bits(e->v_) == bits(v))
+					return e;
+			}
+
+			node* e = nodes_.alloc();
+			*e = node{o, n, static_cast<std::uint32_t>(nodes_.size() - 1), a, b, v};
+			table_[i] = e;
+			return e;
+		}
+
+		void grow()
+		{
+			std::vector<ref> t(table_.empty() ? 1024 : 2 * table_.size(), nullptr);
+			const std::size_t mask = t.size() - 1;
+			for (ref e : table_) {
+				if (!e)
+					continue;
+				std::size_t i = hash(e->op_, e->n_, e->a_, e->b_, e->v_) & mask;
+				while (t[i])
+					i = (i + 1) & mask;
+				t[i] = e;
+			}
+			table_.swap(t);
+		}
+
+		ref drv(ref f, std::uint32_t wrt, std::vector<ref>& memo)
+		{
+			using vm::op;
+
+			if (f->id_ < memo.size() && memo[f->id_])
+				return memo[f->id_];
+
+			ref a = f->a_;
+			ref b = f->b_;
+			ref d = nullptr;
+			switch (f->op_) {
+			case op::cnst:
+				d = constant(T(0));
+				break;
+			case op::var:
+				d = constant(static_cast<std::uint32_t>(f->n_) == wrt ? T(1) : T(0));
+				break;
+			case op::add:
+				d = emit(op::add, drv(a, wrt, memo), drv(b, wrt, memo));
+				break;
+			case op::sub:
+				d = emit(op::sub, drv(a, wrt, memo), drv(b, wrt, memo));
+				break;
+			case op::mul:
+				d = emit(op::add, emit(op::mul, drv(a, wrt, memo), b), emit(op::mul, a, drv(b, wrt, memo)));
+				break;
+			case op::div:
+					// (a` - f * b`) / b
+				d = emit(op::div, emit(op::sub, drv(a, wrt, memo), emit(op::mul, f, drv(b, wrt, memo))), b);
+				break;
+			case op::neg:
+				d = emit(op::neg, drv(a, wrt, memo));
+				break;
+			case op::sin:
+				d = emit(op::mul, emit(op::cos, a), drv(a, wrt, memo));
+				break;
+			case op::cos:
+				d = emit(op::neg, emit(op::mul, emit(op::sin, a), drv(a, wrt, memo)));
+				break;
+			case op::sqrt:
+				d = emit(op::div, drv(a, wrt, memo), emit(op::mul, constant(T(2)), f));
+				break;
+			case op::exp:
+				d = emit(op::mul, f, drv(a, wrt, memo));
+				break;
+			case op::ln:
+				d = emit(op::div, drv(a, wrt, memo), a);
+				break;
+			case op::abs:
+				d = emit(op::mul, emit(op::div, a, f), drv(a, wrt, memo));
+				break;
+			case op::pow: {
+				ref p = emit_imm(op::pow, a, static_cast<std::uint32_t>(f->n_ - 1));
+				d = emit(op::mul, emit(op::mul, constant(static_cast<T>(f->n_)), p), drv(a, wrt, memo));
+				break;
+			}
+			}
+
+			if (f->id_ < memo.size())
+				memo[f->id_] = d;
+			return d;
+		}
+
+		std::uint32_t emit_tape(ref f, tape_builder<T>& b, std::vector<std::uint32_t>& memo) const
+		{
+			if (memo[f->id_] != vm::none)
+				return memo[f->id_];
+
+			std::uint32_t r;
+			switch (f->op_) {
+			case vm::op::cnst:
+				r = b.constant(f->v_);
+				break;
+			case vm::op::var:
+				r = b.variable(static_cast<std::uint32_t>(f->n_));
+				break;
+			case vm::op::pow:
+				r = b.emit_imm(f->op_, emit_tape(f->a_, b, memo), static_cast<std::uint32_t>(f->n_));
+				break;
+			default:
+				if (vm::unary(f->op_)) {
+					r = b.emit(f->op_, emit_tape(f->a_, b, memo));
+				}
+				else {
+					std::uint32_t l = emit_tape(f->a_, b, memo);
+					r = b.emit(f->op_, l, emit_tape(f->b_, b, memo));
+				}
+				break;
+			}
+			memo[f->id_] = r;
+			return r;
+		}
+
+		// recursive descent:
+		// expr := term (('+' | '-') term)*
+		// term := unary (('*' | '/') unary)*
+		// unary := ('-' | '+') unary | power
+		// power := primary ('^' integer)?
+		// primary := number | variable | name '(' expr [',' integer] ')' | '(' expr ')'
+		struct parser
+		{
+			dag& g_;
+			const char* s_;
+			const char* p_;
+
+			void space()
+			{
+				while (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')
+					++p_;
+			}
+			bool next(char c)
+			{
+				space();
+				if (*p_ != c)
+					return false;
+				++p_;
+				return true;
+			}
+			static bool digit(char c)
+			{
+				return c >= '0' && c <= '9';
+			}
+			static bool alpha(char c)
+			{
+				return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+			}
+
+			ref expr()
+			{
+				ref l = term();
+				while (l) {
+					if (next('+'))
+						l = binary(vm::op::add, l, term());
+					else if (next('-'))
+						l = binary(vm::op::sub, l, term());
+					else
+						break;
+				}
+				return l;
+			}
+			ref term()
+			{
+				ref l = unary();
+				while (l) {
+					if (next('*'))
+						l = binary(vm::op::mul, l, unary());
+					else if (next('/'))
+						l = binary(vm::op::div, l, unary());
+					else
+						break;
+				}
+				return l;
+			}
+			ref unary()
+			{
+				if (next('-')) {
+					ref e = unary();
+					return e ? g_.emit(vm::op::neg, e) : nullptr;
+				}
+				if (next('+'))
+					return unary();
+				return power();
+			}
+			ref power()
+			{
+				ref e = primary();
+				if (e && next('^')) {
+					std::int32_t n;
+					if (!integer(n))
+						return nullptr;
+					e = g_.emit_imm(vm::op::pow, e, static_cast<std::uint32_t>(n));
+				}
+				return e;
+			}
+			ref binary(vm::op o, ref l, ref r)
+			{
+				return r ? g_.emit(o, l, r) : nullptr;
+			}
+
+			bool integer(std::int32_t& n)
+			{
+				space();
+				const char* b = p_;
+				char* end;
+				long v = std::strtol(p_, &end, 10);
+				if (end == p_ || !(digit(*b) || ((*b == '-' || *b == '+') && digit(b[1]))))
+					return false;
+				p_ = end;
+				n = static_cast<std::int32_t>(v);
+				return true;
+			}
+
+			ref primary()
+			{
+				space();
+				if (digit(*p_) || (*p_ == '.' && digit(p_[1]))) {
+					char* end;
+					double v = std::strtod(p_, &end);
+					p_ = end;
+					return g_.constant(static_cast<T>(v));
+				}
+				if (*p_ == '(') {
+					++p_;
+					ref e = expr();
+					return e && next(')') ? e : nullptr;
+				}
+				if (!alpha(*p_))
+					return nullptr;
+
+				const char* b = p_;
+				while (alpha(*p_) || digit(*p_))
+					++p_;
+				std::string name(b, p_);
+				for (char& c : name)
+					if (c >= 'A' && c <= 'Z')
+						c = static_cast<char>(c - 'A' + 'a');
+
+				if (name == "x") return g_.variable(0);
+				if (name == "y") return g_.variable(1);
+				if (name == "z") return g_.variable(2);
+				if (name.size() > 1 && name[0] == 'x' && digit(name[1])) {
+					for (std::size_t i = 1; i < name.size(); ++i)
+						if (!digit(name[i])) {
+							p_ = b;
+							return nullptr;
+						}
+					return g_.variable(static_cast<std::uint32_t>(std::strtoul(name.c_str() + 1, nullptr, 10)));
+				}
+
+				static const struct { const char* name_; vm::op op_; } funcs[] = {
+					{"sin", vm::op::sin}, {"cos", vm::op::cos}, {"sqrt", vm::op::sqrt},
+					{"exp", vm::op::exp}, {"ln", vm::op::ln}, {"log", vm::op::ln},
+					{"abs", vm::op::abs}, {"pow", vm::op::pow}
+				};
+				for (const auto& f : funcs) {
+					if (name != f.name_)
+						continue;
+					if (!next('('))
+						return nullptr;
+					ref e = expr();
+					if (!e)
+						return nullptr;
+					std::uint32_t n = 0;
+					if (f.op_ == vm::op::pow) {
+						std::int32_t k;
+						if (!next(',') || !integer(k))
+							return nullptr;
+						n = static_cast<std::uint32_t>(k);
+					}
+					if (!next(')'))
+						return nullptr;
+					return g_.emit_imm(f.op_, e, n);
+				}
+				p_ = b;
+				return nullptr;
+			}
+		};
+	};
+}
+
+#endif
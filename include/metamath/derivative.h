@@ -2,101 +2,191 @@
 #define H_B167998171FB4FBD813140B6FC14688D
 
 #include "func.h"
+#include "simplify.h"
+#include "canonical.h"
 
 namespace metamath
 {
-	template<typename T>
+	// X is the tag of the variable to differentiate by, x by default
+	template<typename T, typename X = empty>
 		struct drv;
 
+	// the nodes are built through combine(), so 0 and 1 factors of the rules
+	// are dropped as they appear instead of growing the intermediate types
+
 	// derivative of a function
-	template<typename E, typename F>
-		struct drv<exp<E, F, func>>
+	template<typename E, typename F, typename X>
+		struct drv<exp<E, F, func>, X>
 		{
 			typedef exp<E, F, func> fexp;
 
-			auto operator()(const fexp& e)
+			constexpr auto operator()(const fexp& e)
 			{
 				//function definition must supply its derivative
-				return (e.derivative()) * (drv<E>{}(e.e_));
+				return combine<mult>(e.derivative(), drv<E, X>{}(e.e_));
 			}
 		};
 
-	// derivative of a variable
-	template<typename E>
-		struct drv<exp<E, empty, variable>>
+	// derivative of a variable, other variables are constants
+	template<typename E, typename Tag, typename X>
+		struct drv<exp<E, Tag, variable>, X>
 		{
-			typedef exp<E, empty, variable> vexp;
+			typedef exp<E, Tag, variable> vexp;
 
-			auto operator()(const vexp&)
+			constexpr auto operator()(const vexp&)
 			{
-				return exp<E, empty, constant>{identity<E>::v};
+				return lit<var_index<Tag>::value == var_index<X>::value ? 1 : 0>{};
 			}
 		};
 
-	// derivative of a constant
-	template<typename E>
-		struct drv<exp<E, empty, constant>>
+	// derivative of a constant or a parameter
+	template<typename E, typename X>
+		struct drv<exp<E, empty, constant>, X>
 		{
 			typedef exp<E, empty, constant> cexp;
 
-			auto operator()(const cexp&)
+			constexpr auto operator()(const cexp&)
+			{
+				return lit<0>{};
+			}
+		};
+	template<typename E, typename X>
+		struct drv<exp<E, empty, parameter>, X>
+		{
+			typedef exp<E, empty, parameter> pexp;
+
+			constexpr auto operator()(const pexp&)
+			{
+				return lit<0>{};
+			}
+		};
+	template<int N, typename X>
+		struct drv<lit<N>, X>
+		{
+			constexpr auto operator()(const lit<N>&)
 			{
-				return exp<E, empty, constant>{zero<E>::v};
+				return lit<0>{};
 			}
 		};
 
 	// derivative of a product
-	template<typename E1, typename E2>
-		struct drv<exp<E1, E2, mult>>
+	template<typename E1, typename E2, typename X>
+		struct drv<exp<E1, E2, mult>, X>
 		{
 			typedef exp<E1, E2, mult> mexp;
 
-			auto operator()(const mexp& e)
+			constexpr auto operator()(const mexp& e)
 			{
-				return (drv<E1>{}(e.e1_) * e.e2_) + (e.e1_ * drv<E2>{}(e.e2_));
+				return combine<plus>(combine<mult>(drv<E1, X>{}(e.e1_), e.e2_),
+					combine<mult>(e.e1_, drv<E2, X>{}(e.e2_)));
 			}
 		};
 
 	// derivative of a division
-	template<typename E1, typename E2>
-		struct drv<exp<E1, E2, div>>
+	template<typename E1, typename E2, typename X>
+		struct drv<exp<E1, E2, div>, X>
 		{
 			typedef exp<E1, E2, div> dexp;
 
-			auto operator()(const dexp& e)
+			constexpr auto operator()(const dexp& e)
 			{
-				return (drv<E1>{}(e.e1_) * e.e2_ - e.e1_ * drv<E2>{}(e.e2_)) / (e.e2_ * e.e2_);
+				return combine<div>(combine<minus>(combine<mult>(drv<E1, X>{}(e.e1_), e.e2_),
+					combine<mult>(e.e1_, drv<E2, X>{}(e.e2_))), e.e2_ * e.e2_);
+			}
+		};
+
+	// by a constant, a parameter or a literal the divisor stays as it is
+	template<typename E1, typename T, typename X>
+		struct drv<exp<E1, exp<T, empty, constant>, div>, X>
+		{
+			typedef exp<E1, exp<T, empty, constant>, div> dexp;
+
+			constexpr auto operator()(const dexp& e)
+			{
+				return combine<div>(drv<E1, X>{}(e.e1_), e.e2_);
+			}
+		};
+	template<typename E1, typename T, typename X>
+		struct drv<exp<E1, exp<T, empty, parameter>, div>, X>
+		{
+			typedef exp<E1, exp<T, empty, parameter>, div> dexp;
+
+			constexpr auto operator()(const dexp& e)
+			{
+				return combine<div>(drv<E1, X>{}(e.e1_), e.e2_);
+			}
+		};
+	template<typename E1, int N, typename X>
+		struct drv<exp<E1, lit<N>, div>, X>
+		{
+			typedef exp<E1, lit<N>, div> dexp;
+
+			constexpr auto operator()(const dexp& e)
+			{
+				return combine<div>(drv<E1, X>{}(e.e1_), e.e2_);
 			}
 		};
 
 	// derivative of additions
-	template<typename E1, typename E2>
-		struct drv<exp<E1, E2, plus>>
+	template<typename E1, typename E2, typename X>
+		struct drv<exp<E1, E2, plus>, X>
 		{
 			typedef exp<E1, E2, plus> pexp;
 
-			auto operator()(const pexp& e)
+			constexpr auto operator()(const pexp& e)
 			{
-				return drv<E1>{}(e.e1_) + drv<E2>{}(e.e2_);
+				return combine<plus>(drv<E1, X>{}(e.e1_), drv<E2, X>{}(e.e2_));
 			}
 		};
-	template<typename E1, typename E2>
-		struct drv<exp<E1, E2, minus>>
+	template<typename E1, typename E2, typename X>
+		struct drv<exp<E1, E2, minus>, X>
 		{
 			typedef exp<E1, E2, minus> mexp;
 
-			auto operator()(const mexp& e)
+			constexpr auto operator()(const mexp& e)
 			{
-				return drv<E1>{}(e.e1_) - drv<E2>{}(e.e2_);
+				return combine<minus>(drv<E1, X>{}(e.e1_), drv<E2, X>{}(e.e2_));
+			}
+		};
+
+	// derivative of a negation
+	template<typename E, typename X>
+		struct drv<exp<E, empty, negate>, X>
+		{
+			typedef exp<E, empty, negate> nexp;
+
+			constexpr auto operator()(const nexp& e)
+			{
+				return combine_neg(drv<E, X>{}(e.e_));
 			}
 		};
 
 	
-	// wrap it
+	// wrap it, the result goes through the simplify() pass
+	template<typename E>
+		constexpr auto derivative(const E& e)
+		{
+			return simplify(drv<E>()(e));
+		}
+
+	// partial derivative by the variable v
+	template<typename E, typename T, typename Tag>
+		constexpr auto derivative(const E& e, const exp<T, Tag, variable>&)
+		{
+			return simplify(drv<E, Tag>()(e));
+		}
+
+	// the same through the canonical() pass: costs compile time on small
+	// expressions, pays off on repeated derivatives, whose types stop nesting
 	template<typename E>
-		auto derivative(const E& e)
+		constexpr auto canonical_derivative(const E& e)
+		{
+			return canonical(drv<E>()(e));
+		}
+	template<typename E, typename T, typename Tag>
+		constexpr auto canonical_derivative(const E& e, const exp<T, Tag, variable>&)
 		{
-			return drv<E>()(e);
+			return canonical(drv<E, Tag>()(e));
 		}
 }
 
@@ -0,0 +1,191 @@
+#ifndef H_143050D90D854F07851956AD67A8C04D
+#define H_143050D90D854F07851956AD67A8C04D
+
+#include <cstddef>
+#include <type_traits>
+#include "func.h"
+#include "batch.h"
+
+namespace metamath
+{
+	namespace ad
+	{
+		// forward-mode dual number: value and derivative
+		// walking an expression with it yields f(x) and f`(x) in one pass
+		template<typename T>
+		struct dual
+		{
+			typedef T type;
+
+			T v_; //value
+			T d_; //derivative
+		};
+
+		template<typename U>
+		using if_scalar = std::enable_if_t<std::is_arithmetic<U>::value>;
+
+		// arithmetic
+		//
+		template<typename T>
+		constexpr dual<T> operator+(const dual<T>& a, const dual<T>& b)
+		{
+			return {a.v_ + b.v_, a.d_ + b.d_};
+		}
+		template<typename T, typename U, typename = if_scalar<U>>
+		constexpr dual<T> operator+(const dual<T>& a, U b)
+		{
+			return {a.v_ + T(b), a.d_};
+		}
+		template<typename U, typename T, typename = if_scalar<U>>
+		constexpr dual<T> operator+(U a, const dual<T>& b)
+		{
+			return {T(a) + b.v_, b.d_};
+		}
+
+		template<typename T>
+		constexpr dual<T> operator-(const dual<T>& a, const dual<T>& b)
+		{
+			return {a.v_ - b.v_, a.d_ - b.d_};
+		}
+		template<typename T, typename U, typename = if_scalar<U>>
+		constexpr dual<T> operator-(const dual<T>& a, U b)
+		{
+			return {a.v_ - T(b), a.d_};
+		}
+		template<typename U, typename T, typename = if_scalar<U>>
+		constexpr dual<T> operator-(U a, const dual<T>& b)
+		{
+			return {T(a) - b.v_, -b.d_};
+		}
+
+		template<typename T>
+		constexpr dual<T> operator*(const dual<T>& a, const dual<T>& b)
+		{
+			return {a.v_ * b.v_, a.d_ * b.v_ + a.v_ * b.d_};
+		}
+		template<typename T, typename U, typename = if_scalar<U>>
+		constexpr dual<T> operator*(const dual<T>& a, U b)
+		{
+			return {a.v_ * T(b), a.d_ * T(b)};
+		}
+		template<typename U, typename T, typename = if_scalar<U>>
+		constexpr dual<T> operator*(U a, const dual<T>& b)
+		{
+			return {T(a) * b.v_, T(a) * b.d_};
+		}
+
+		template<typename T>
+		constexpr dual<T> operator/(const dual<T>& a, const dual<T>& b)
+		{
+			T r = a.v_ / b.v_;
+			return {r, (a.d_ - r * b.d_) / b.v_};
+		}
+		template<typename T, typename U, typename = if_scalar<U>>
+		constexpr dual<T> operator/(const dual<T>& a, U b)
+		{
+			return {a.v_ / T(b), a.d_ / T(b)};
+		}
+		template<typename U, typename T, typename = if_scalar<U>>
+		constexpr dual<T> operator/(U a, const dual<T>& b)
+		{
+			T r = T(a) / b.v_;
+			return {r, -r * b.d_ / b.v_};
+		}
+
+		template<typename T>
+		constexpr dual<T> operator-(const dual<T>& a)
+		{
+			return {-a.v_, -a.d_};
+		}
+
+		// functions, each goes through the fused kernel of its func.h functor
+		// (integer powers are multiply chains and need no overload)
+		//
+		template<typename F, typename T>
+		dual<T> chain(const F& f, const dual<T>& a)
+		{
+			dual<T> r;
+			T df;
+			f.fused(a.v_, r.v_, df);
+			r.d_ = df * a.d_;
+			return r;
+		}
+
+		template<typename T>
+		dual<T> sin(const dual<T>& a)
+		{
+			return chain(sin_f{}, a);
+		}
+		template<typename T>
+		dual<T> cos(const dual<T>& a)
+		{
+			return chain(cos_f{}, a);
+		}
+		template<typename T>
+		dual<T> sqrt(const dual<T>& a)
+		{
+			return chain(sqrt_f{}, a);
+		}
+		template<typename T>
+		dual<T> exp(const dual<T>& a)
+		{
+			return chain(exponent_f{}, a);
+		}
+		template<typename T>
+		dual<T> log(const dual<T>& a)
+		{
+			return chain(ln_f{}, a);
+		}
+		template<typename T>
+		dual<T> abs(const dual<T>& a)
+		{
+			return chain(abs_f{}, a);
+		}
+
+		// results of expressions without a variable are constants
+		template<typename T>
+		constexpr dual<T> lift(const dual<T>& v)
+		{
+			return v;
+		}
+		template<typename T, typename U>
+		constexpr dual<T> lift(U v)
+		{
+			return {T(v), T(0)};
+		}
+	}
+
+	// integer arguments evaluate in the default domain
+	template<typename T>
+	using eval_domain = std::conditional_t<std::is_integral<T>::value, domain, T>;
+
+	// f(v) and f`(v) in a single walk of the expression tree
+	template<typename E, typename T>
+	ad::dual<eval_domain<T>> value_and_derivative(const E& e, T v)
+	{
+		typedef eval_domain<T> R;
+		return ad::lift<R>(e(ad::dual<R>{R(v), R(1)}));
+	}
+
+	// batch form: val[i] = f(in[i]), der[i] = f`(in[i])
+	template<typename E, typename T>
+	void value_and_derivative(const E& e, const T* in, T* val, T* der, std::size_t n)
+	{
+		constexpr std::size_t N = simd::lanes<T>::value;
+		typedef simd::pack<T, N> pack_t;
+
+		std::size_t i = 0;
+		for (; i + N <= n; i += N) {
+			auto r = ad::lift<pack_t>(e(ad::dual<pack_t>{pack_t::load(in + i), pack_t(1)}));
+			r.v_.store(val + i);
+			r.d_.store(der + i);
+		}
+		for (; i < n; ++i) {
+			auto r = value_and_derivative(e, in[i]);
+			val[i] = r.v_;
+			der[i] = r.d_;
+		}
+	}
+}
+
+#endif
@@ -2,8 +2,27 @@
 #define H_C5A1C710C76845F8AE8B0E2F16424836
 
 #include <assert.h>
+#include <cstddef>
 #include <limits>
 #include <cmath>
+#include <ostream>
+#include <type_traits>
+
+// operands of an empty type (variables, literals) take no space in their
+// parent node, [[no_unique_address]] is honoured by gcc and clang before C++20
+#if defined(_MSC_VER) && _MSC_VER >= 1929
+#define METAMATH_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#elif defined(__has_cpp_attribute)
+#if __has_cpp_attribute(no_unique_address)
+#define METAMATH_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+#endif
+#if defined(METAMATH_NO_UNIQUE_ADDRESS)
+#define METAMATH_COMPACT_LAYOUT 1
+#else
+#define METAMATH_NO_UNIQUE_ADDRESS
+#define METAMATH_COMPACT_LAYOUT 0
+#endif
 
 namespace metamath
 {
@@ -11,6 +30,34 @@ namespace metamath
 	// the default variable name, 'x' is mapped to this domain type
 	typedef float domain;
 
+	// scalar type of an evaluation argument (float, simd::pack<float, N>, ...)
+	template<typename...>
+	struct void_type
+	{
+		typedef void type;
+	};
+	template<typename V, typename = void>
+	struct scalar_of
+	{
+		typedef V type;
+	};
+	template<typename V>
+	struct scalar_of<V, typename void_type<typename V::type>::type>
+	{
+		typedef typename scalar_of<typename V::type>::type type;
+	};
+
+	// integer constants evaluate in floating point, at least the domain type,
+	// so that e.g. (2) / (2 * 2) is not an integer division
+	template<typename T, typename V>
+	using const_t = std::conditional_t<std::is_integral<T>::value,
+		std::common_type_t<domain, typename scalar_of<V>::type>, T>;
+
+	// arguments that carry several points at once (simd::pack), kernels may
+	// choose a scheme with more independent operations for them
+	template<typename V>
+	struct is_block : std::false_type {};
+
 	// operation and other tags
 	struct plus;
 	struct minus;
@@ -19,6 +66,9 @@ namespace metamath
 	struct func;
 	struct variable;
 	struct constant;
+	struct literal;
+	struct parameter;
+	struct negate;
 
 	struct empty;
 
@@ -72,13 +122,11 @@ namespace metamath
 	{
 		return v == zero<int>::v;
 	}
+	// zero or one step away from it (the smallest denormal)
 	template<typename T>
 	constexpr bool is_zero(T v)
 	{
-		if ( (std::nextafter(v, std::numeric_limits<T>::lowest()) > zero<T>::v)
-			|| (std::nextafter(v, std::numeric_limits<T>::max()) < zero<T>::v) )
-			return false;
-		return true;
+		return v >= -std::numeric_limits<T>::denorm_min() && v <= std::numeric_limits<T>::denorm_min();
 	}
 	
 	constexpr bool is_identity(int v) 
@@ -88,10 +136,12 @@ namespace metamath
 	template<typename T>
 	constexpr bool is_identity(T v)
 	{
-		return is_zero<T>(std::abs(v - identity<T>::v));
+		return is_zero<T>(v - identity<T>::v);
 	}
 
 	// checks for exp<>
+	// value: known at compile time (literals)
+	// check(): also looks at runtime constants, for printing
 	//
 	template<typename ...T> struct is_zero_t;
 
@@ -100,6 +150,7 @@ namespace metamath
 	struct is_zero_t< exp<T...> >
 	{
 		typedef exp<T...> exp_t;
+		static constexpr bool value = false;
 		static constexpr bool check(const exp_t&)
 		{
 			return false;
@@ -109,9 +160,20 @@ namespace metamath
 	struct is_zero_t<exp<T, empty, constant>>
 	{
 		typedef exp<T, empty, constant> exp_t;
+		static constexpr bool value = false;
 		static constexpr bool check(const exp_t& e)
 		{
-			return e.z_;
+			return is_zero(e.v_);
+		}
+	};
+	template<int N>
+	struct is_zero_t<exp<std::integral_constant<int, N>, empty, literal>>
+	{
+		typedef exp<std::integral_constant<int, N>, empty, literal> exp_t;
+		static constexpr bool value = N == 0;
+		static constexpr bool check(const exp_t&)
+		{
+			return value;
 		}
 	};
 	template<typename T>
@@ -119,6 +181,11 @@ namespace metamath
 	{
 		return is_zero_t<T>::check(e);
 	}
+	template<typename T>
+	constexpr bool is_zero_const()
+	{
+		return is_zero_t<T>::value;
+	}
 	
 
 			//allow exp<> types only
@@ -128,6 +195,7 @@ namespace metamath
 	struct is_identity_t<exp<T...>>
 	{
 		typedef exp<T...> exp_t;
+		static constexpr bool value = false;
 		static constexpr bool check(const exp_t&)
 		{
 			return false;
@@ -137,9 +205,20 @@ namespace metamath
 	struct is_identity_t<exp<T, empty, constant>>
 	{
 		typedef exp<T, empty, constant> exp_t;
+		static constexpr bool value = false;
 		static constexpr bool check(const exp_t& e)
 		{
-			return e.u_;
+			return is_identity(e.v_);
+		}
+	};
+	template<int N>
+	struct is_identity_t<exp<std::integral_constant<int, N>, empty, literal>>
+	{
+		typedef exp<std::integral_constant<int, N>, empty, literal> exp_t;
+		static constexpr bool value = N == 1;
+		static constexpr bool check(const exp_t&)
+		{
+			return value;
 		}
 	};
 	template<typename T>
@@ -147,6 +226,11 @@ namespace metamath
 	{
 		return is_identity_t<T>::check(e);
 	}
+	template<typename T>
+	constexpr bool is_identity_const()
+	{
+		return is_identity_t<T>::value;
+	}
 
 	// expression specializations
 	//
@@ -156,23 +240,19 @@ namespace metamath
 		typedef T type;
 
 		T v_;
-		bool z_; //indicates zero
-		bool u_; //indicates identity
 
-		exp(T v) 
-			:v_{v} 
-			,z_{is_zero(v)}
-			,u_{is_identity(v)}
+		constexpr exp(T v)
+			:v_{v}
 		{
 		}
 
 		template<typename V>
-		constexpr T operator()(V v) const
+		constexpr const_t<T, V> operator()(V) const
 		{
 			return v_;
 		}
 		template<typename E1, typename E2, typename Op>
-		constexpr auto operator()(const exp<E1, E2, Op>& e)
+		constexpr auto operator()(const exp<E1, E2, Op>& e) const
 		{
 			return *this;
 		}
@@ -185,18 +265,177 @@ namespace metamath
 		}
 	};
 
-	// variable expression
+	// compile-time integer constant, the value is part of the type
+	template<int N>
+	struct exp<std::integral_constant<int, N>, empty, literal>
+	{
+		typedef int type;
+		static constexpr int value = N;
+
+		template<typename V>
+		constexpr const_t<int, V> operator()(V) const
+		{
+			return N;
+		}
+		template<typename E1, typename E2, typename Op>
+		constexpr auto operator()(const exp<E1, E2, Op>&) const
+		{
+			return *this;
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << N;
+			return os;
+		}
+	};
+
+	template<int N>
+		using lit = exp<std::integral_constant<int, N>, empty, literal>;
+
+	// a named value that may change after an expression is built,
+	// Param(a) nodes refer to it: it must outlive them and is not copied
+	template<typename T>
+	struct param
+	{
+		typedef T type;
+
+		const char* name_;
+		T v_;
+
+		constexpr param(const char* name, T v)
+			:name_{name}, v_{v}
+		{
+		}
+		param(const param&) = delete;
+		param& operator=(const param&) = delete;
+
+		param& operator=(T v)
+		{
+			v_ = v;
+			return *this;
+		}
+		constexpr T value() const
+		{
+			return v_;
+		}
+	};
+
+	// parameter expression, evaluates to the current value of its param
 	template<typename T>
-	struct exp<T, empty, variable>
+	struct exp<T, empty, parameter>
+	{
+		typedef T type;
+
+		const param<T>* p_;
+
+		constexpr exp(const param<T>& p)
+			:p_{&p}
+		{
+		}
+
+		template<typename V>
+		constexpr const_t<T, V> operator()(V) const
+		{
+			return p_->v_;
+		}
+		template<typename E1, typename E2, typename Op>
+		constexpr auto operator()(const exp<E1, E2, Op>&) const
+		{
+			return *this;
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << p_->name_;
+			return os;
+		}
+	};
+
+	template<typename T>
+	constexpr exp<T, empty, parameter> Param(const param<T>& p)
+	{
+		return {p};
+	}
+
+	// variable tags, a tag supplies the index of its variable
+	// user tags are any type with a static constexpr int index
+	template<int I>
+	struct tag
+	{
+		static constexpr int index = I;
+	};
+
+	template<typename Tag>
+	struct var_index
+	{
+		static constexpr int value = Tag::index;
+	};
+	template<>
+	struct var_index<empty>
+	{
+		static constexpr int value = 0;
+	};
+
+	// values of several variables, slot i belongs to the variable with index i
+	template<typename T, std::size_t N>
+	struct point
+	{
+		typedef T type;
+		static constexpr std::size_t size = N;
+
+		T v_[N];
+
+		constexpr T& operator[](std::size_t i)
+		{
+			return v_[i];
+		}
+		constexpr const T& operator[](std::size_t i) const
+		{
+			return v_[i];
+		}
+	};
+
+	template<typename T, typename ...U>
+	using point_t = point<std::conditional_t<std::is_integral<std::common_type_t<T, U...>>::value,
+		domain, std::common_type_t<T, U...>>, 1 + sizeof...(U)>;
+
+	// at(1.f, 2.f) binds x = 1, y = 2
+	template<typename T, typename ...U>
+	constexpr point_t<T, U...> at(T v, U... vs)
+	{
+		typedef typename point_t<T, U...>::type R;
+		return {{static_cast<R>(v), static_cast<R>(vs)...}};
+	}
+
+	// variable expression
+	template<typename T, typename Tag>
+	struct exp<T, Tag, variable>
 	{
 		typedef T type;
+		static constexpr int index = var_index<Tag>::value;
 
+			//a scalar is the value of the variable
 		constexpr T operator()(T v) const
 		{
 			return v;
 		}
+		template<typename U, std::size_t N>
+		constexpr U operator()(const point<U, N>& p) const
+		{
+			static_assert(index < static_cast<int>(N), "no value for the variable");
+			return p.v_[index];
+		}
+			//non-arithmetic domains (e.g. simd::pack) pass through as is
+		template<typename V, typename = std::enable_if_t<!std::is_arithmetic<V>::value>>
+		constexpr V operator()(const V& v) const
+		{
+			return v;
+		}
 		template<typename E1, typename E2, typename Op>
-		constexpr exp<E1, E2, Op> operator()(const exp<E1, E2, Op>& e)
+		constexpr exp<E1, E2, Op> operator()(const exp<E1, E2, Op>& e) const
 		{
 			return e;
 		}
@@ -205,7 +444,12 @@ namespace metamath
 		template<typename Os>
 		Os& print(Os& os) const
 		{
-			os << "x";
+			switch (index) {
+			case 0: os << "x"; break;
+			case 1: os << "y"; break;
+			case 2: os << "z"; break;
+			default: os << "x" << index; break;
+			}
 			return os;
 		}
 	};
@@ -214,22 +458,24 @@ namespace metamath
 	template<typename Domain=domain>
 		using var = exp<Domain, empty, variable>;
 
+	// variable placeholder with a tag
+	template<typename Tag, typename Domain=domain>
+		using var_t = exp<Domain, Tag, variable>;
+
 	template<typename E1, typename E2>
 	struct exp<E1, E2, div>
 	{
-		E1 e1_;
-		E2 e2_;
+		METAMATH_NO_UNIQUE_ADDRESS E1 e1_;
+		METAMATH_NO_UNIQUE_ADDRESS E2 e2_;
 
+			//no runtime checks here, literal 1 divisors are removed by simplify()
 		template<typename V>
 		constexpr decltype(e1_(V{}) / e2_(V{})) operator()(V v) const
 		{
-			if (is_identity_const(e2_)) {
-				return e1_(v);
-			}
 			return e1_(v) / e2_(v);
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return e1_(e) / e2_(e);
 		}
@@ -246,28 +492,87 @@ namespace metamath
 		}
 	};
 
+	// division by a constant multiplies by the reciprocal, computed once
+	// (the result may differ from a true division in the last bit)
+	template<typename E1, typename T>
+	struct exp<E1, exp<T, empty, constant>, div>
+	{
+		typedef exp<T, empty, constant> E2;
+		typedef std::conditional_t<std::is_integral<T>::value, double, T> rtype;
+
+		METAMATH_NO_UNIQUE_ADDRESS E1 e1_;
+		METAMATH_NO_UNIQUE_ADDRESS E2 e2_;
+		rtype r_; //1 / e2_
+
+		constexpr exp(const E1& e1, const E2& e2)
+			:e1_{e1}
+			,e2_{e2}
+			,r_{1 / static_cast<rtype>(e2.v_)}
+		{
+		}
+
+		template<typename V>
+		constexpr decltype(e1_(V{}) / e2_(V{})) operator()(V v) const
+		{
+			return e1_(v) * static_cast<const_t<T, V>>(r_);
+		}
+		template<typename T1, typename T2, typename Op>
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
+		{
+			return e1_(e) / e2_(e);
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << "((" << e1_ << ")" << " / " << "(" << e2_ << "))";
+			return os;
+		}
+	};
+
+	template<typename E1, int N>
+	struct exp<E1, lit<N>, div>
+	{
+		METAMATH_NO_UNIQUE_ADDRESS E1 e1_;
+		METAMATH_NO_UNIQUE_ADDRESS lit<N> e2_;
+
+		template<typename V>
+		constexpr decltype(e1_(V{}) / e2_(V{})) operator()(V v) const
+		{
+			return e1_(v) * (const_t<int, V>(1) / N);
+		}
+		template<typename T1, typename T2, typename Op>
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
+		{
+			return e1_(e) / e2_;
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			if (N == 1) {
+				os << e1_;
+				return os;
+			}
+			os << "((" << e1_ << ")" << " / " << "(" << e2_ << "))";
+			return os;
+		}
+	};
+
 	template<typename E1, typename E2>
 	struct exp<E1, E2, mult>
 	{
-		E1 e1_;
-		E2 e2_;
+		METAMATH_NO_UNIQUE_ADDRESS E1 e1_;
+		METAMATH_NO_UNIQUE_ADDRESS E2 e2_;
 
+			//branch-free, literal 0 and 1 operands are removed by simplify()
 		template<typename V>
 		constexpr decltype(e1_(V{}) * e2_(V{})) operator()(V v) const
 		{
-			if (is_zero_const(e1_) || is_zero_const(e2_)) {
-				return zero<V>::v;
-			}
-			if (is_identity_const(e1_)) {
-				return e2_(v);
-			}
-			if (is_identity_const(e2_)) {
-				return e1_(v);
-			}
 			return e1_(v) * e2_(v);
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return e1_(e) * e2_(e);
 		}
@@ -291,8 +596,8 @@ namespace metamath
 	template<typename E1, typename E2>
 	struct exp<E1, E2, plus>
 	{
-		E1 e1_;
-		E2 e2_;
+		METAMATH_NO_UNIQUE_ADDRESS E1 e1_;
+		METAMATH_NO_UNIQUE_ADDRESS E2 e2_;
 
 		template<typename V>
 			//must use decltype in case adding another return
@@ -301,7 +606,7 @@ namespace metamath
 			return e1_(v) + e2_(v);
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return e1_(e) + e2_(e);
 		}
@@ -325,8 +630,8 @@ namespace metamath
 	template<typename E1, typename E2>
 	struct exp<E1, E2, minus>
 	{
-		E1 e1_;
-		E2 e2_;
+		METAMATH_NO_UNIQUE_ADDRESS E1 e1_;
+		METAMATH_NO_UNIQUE_ADDRESS E2 e2_;
 
 		template<typename V>
 			//must use decltype in case adding another return
@@ -335,7 +640,7 @@ namespace metamath
 			return e1_(v) - e2_(v);
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return e1_(e) - e2_(e);
 		}
@@ -356,6 +661,30 @@ namespace metamath
 		}
 	};
 
+	template<typename E>
+	struct exp<E, empty, negate>
+	{
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
+
+		template<typename V>
+		constexpr decltype(-e_(V{})) operator()(V v) const
+		{
+			return -e_(v);
+		}
+		template<typename T1, typename T2, typename Op>
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
+		{
+			return -e_(e);
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << "-" << e_;
+			return os;
+		}
+	};
+
 	// operators
 	//
 
@@ -380,29 +709,46 @@ namespace metamath
 		typedef exp<double, empty, constant> type;
 	};
 
-	template<typename E1, typename E2>
-	exp<typename exp_type<E1>::type, typename exp_type<E2>::type, plus>
+	// the operators take part only if an operand is an expression,
+	// other types of the namespace (std iterators of local types, ...) keep theirs
+	template<typename T>
+	struct is_exp : std::false_type {};
+	template<typename E1, typename E2, typename Op>
+	struct is_exp<exp<E1, E2, Op>> : std::true_type {};
+
+	template<typename E1, typename E2 = E1>
+	using if_exp = std::enable_if_t<is_exp<E1>::value || is_exp<E2>::value>;
+
+	template<typename E, typename = if_exp<E>>
+	constexpr exp<typename exp_type<E>::type, empty, negate>
+	operator-(const E& e)
+	{
+		return {e};
+	}
+
+	template<typename E1, typename E2, typename = if_exp<E1, E2>>
+	constexpr exp<typename exp_type<E1>::type, typename exp_type<E2>::type, plus>
 	operator+(const E1& e1, const E2& e2)
 	{
 		return {e1, e2};
 	}
 
-	template<typename E1, typename E2>
-	exp<typename exp_type<E1>::type, typename exp_type<E2>::type, minus>
+	template<typename E1, typename E2, typename = if_exp<E1, E2>>
+	constexpr exp<typename exp_type<E1>::type, typename exp_type<E2>::type, minus>
 	operator-(const E1& e1, const E2& e2)
 	{
 		return {e1, e2};
 	}
 
-	template<typename E1, typename E2>
-	exp<typename exp_type<E1>::type, typename exp_type<E2>::type, mult>
+	template<typename E1, typename E2, typename = if_exp<E1, E2>>
+	constexpr exp<typename exp_type<E1>::type, typename exp_type<E2>::type, mult>
 	operator*(const E1& e1, const E2& e2)
 	{
 		return {e1, e2};
 	}
 
-	template<typename E1, typename E2>
-	exp<typename exp_type<E1>::type, typename exp_type<E2>::type, div>
+	template<typename E1, typename E2, typename = if_exp<E1, E2>>
+	constexpr exp<typename exp_type<E1>::type, typename exp_type<E2>::type, div>
 	operator/(const E1& e1, const E2& e2)
 	{
 		return {e1, e2};
@@ -419,6 +765,27 @@ namespace metamath
 	// the default variable label
 	static constexpr var<domain> x;
 
+	// more labels for multi-variable expressions
+	static constexpr var_t<tag<1>> y;
+	static constexpr var_t<tag<2>> z;
+
+	// layout: a constant is its value, variables and literals are empty,
+	// and with METAMATH_COMPACT_LAYOUT they take no space in a parent node
+	//
+	static_assert(sizeof(exp<float, empty, constant>) == sizeof(float), "constant layout");
+	static_assert(sizeof(exp<double, empty, constant>) == sizeof(double), "constant layout");
+	static_assert(std::is_empty<var<domain>>::value, "variable layout");
+	static_assert(std::is_empty<lit<2>>::value, "literal layout");
+#if METAMATH_COMPACT_LAYOUT
+	static_assert(sizeof(exp<exp<int, empty, constant>, var<domain>, mult>) == sizeof(int), "product layout");
+	static_assert(sizeof(exp<var<domain>, exp<float, empty, constant>, plus>) == sizeof(float), "sum layout");
+	static_assert(sizeof(exp<exp<float, empty, constant>, var<domain>, minus>) == sizeof(float), "difference layout");
+	static_assert(sizeof(exp<var<domain>, exp<float, empty, constant>, div>) == 2 * sizeof(float), "quotient layout");
+	static_assert(sizeof(exp<exp<float, empty, constant>, lit<2>, div>) == sizeof(float), "quotient layout");
+	static_assert(std::is_empty<exp<var<domain>, lit<1>, plus>>::value, "sum layout");
+	static_assert(std::is_empty<exp<var<domain>, empty, negate>>::value, "negation layout");
+#endif
+
 }
 
 #endif
@@ -3,41 +3,66 @@
 
 #include <cmath> 
 #include "exp.h"
+#include "cxmath.h"
 
 namespace metamath
 {
+	// the functors call the math functions unqualified, so
+	// other evaluation domains (simd::pack, ...) supply theirs via ADL,
+	// for numbers they are the cx:: ones, which also work in constant expressions
+
 		// trigonometric functions
 		// 
 
 	struct sin_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			using cx::sin;
+			return sin(v);
+		}
+		// value and derivative at v, sin and cos of the same
+		// argument are merged into one sincos call by the compiler
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
 		{
-			return std::sin(v);
+			using cx::sin;
+			using cx::cos;
+			f = sin(v);
+			df = cos(v);
 		}
 	};
 	struct cos_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			using cx::cos;
+			return cos(v);
+		}
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
 		{
-			return std::cos(v);
+			using cx::sin;
+			using cx::cos;
+			f = cos(v);
+			df = -sin(v);
 		}
 	};
 
 	template<typename E>
 	struct exp<E, sin_f, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return sin_f{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), sin_f, func>{e_(e)};
 		}
@@ -49,7 +74,7 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
 			return exp<E, cos_f, func>{e_};
 		}
@@ -58,15 +83,15 @@ namespace metamath
 	template<typename E>
 	struct exp<E, cos_f, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return cos_f{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), cos_f, func>{e_(e)};
 		}
@@ -78,9 +103,9 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
-			return exp<E, sin_f, func>{e_} * -1;
+			return -exp<E, sin_f, func>{e_};
 		}
 	};
 
@@ -102,24 +127,32 @@ namespace metamath
 	struct sqrt_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			using cx::sqrt;
+			return sqrt(v);
+		}
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
 		{
-			return std::sqrt(v);
+			using cx::sqrt;
+			f = sqrt(v);
+			df = T(1) / (2 * f);
 		}
 	};
 	
 	template<typename E>
 	struct exp<E, sqrt_f, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return sqrt_f{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), sqrt_f, func>{e_(e)};
 		}
@@ -131,9 +164,9 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
-			return 1 / (2 * exp<E, sqrt_f, func>{e_});
+			return lit<1>{} / (lit<2>{} * exp<E, sqrt_f, func>{e_});
 		}
 	};
 
@@ -146,38 +179,74 @@ namespace metamath
 
 		// POW
 
+	// v^N, N > 0, by repeated squaring unrolled at compile time
 	template<int N>
-	struct pow_f
+	struct ipow
 	{
 		template<typename T>
-		auto operator()(T v) const
+		static constexpr T apply(const T& v)
 		{
-			return std::pow(v, N); 
+			T h = ipow<N / 2>::apply(v);
+			return N % 2 ? h * h * v : h * h;
 		}
-	}; 
-
+	};
 	template<>
-	struct pow_f<1>
+	struct ipow<1>
+	{
+		template<typename T>
+		static constexpr T apply(const T& v)
+		{
+			return v;
+		}
+	};
+
+	// integer powers are multiply chains, no std::pow call
+	template<int N>
+	struct pow_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			return apply(v, std::integral_constant<int, (N > 0) - (N < 0)>{});
+		}
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
+		{
+			T p = pow_f<N - 1>{}(v);
+			f = N == 0 ? T(1) : p * v;
+			df = N == 0 ? T(0) : N * p;
+		}
+
+	private:
+		template<typename T>
+		static constexpr T apply(const T& v, std::integral_constant<int, 1>)
+		{
+			return ipow<N>::apply(v);
+		}
+		template<typename T>
+		static constexpr auto apply(const T& v, std::integral_constant<int, -1>)
+		{
+			return 1 / ipow<-N>::apply(v);
+		}
+		template<typename T>
+		static constexpr const_t<int, T> apply(const T&, std::integral_constant<int, 0>)
 		{
-			return v; 
+			return 1;
 		}
 	}; 
 
 	template<typename E, int N>
 	struct exp<E, pow_f<N>, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return pow_f<N>{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), pow_f<N>, func>{e_(e)};
 		}
@@ -189,9 +258,9 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
-			return N * (exp<E, pow_f<N-1>, func>{e_});
+			return lit<N>{} * (exp<E, pow_f<N-1>, func>{e_});
 		}
 	};
 
@@ -209,24 +278,32 @@ namespace metamath
 	struct exponent_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			using cx::exp;
+			return exp(v);
+		}
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
 		{
-			return std::exp(v);
+			using cx::exp;
+			f = exp(v);
+			df = f;
 		}
 	};
 	
 	template<typename E>
 	struct exp<E, exponent_f, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return exponent_f{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), exponent_f, func>{e_(e)};
 		}
@@ -238,7 +315,7 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
 			return exp<E, exponent_f, func>{e_};
 		}
@@ -255,24 +332,32 @@ namespace metamath
 	struct ln_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			using cx::log;
+			return log(v);
+		}
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
 		{
-			return std::log(v);
+			using cx::log;
+			f = log(v);
+			df = T(1) / v;
 		}
 	};
 	
 	template<typename E>
 	struct exp<E, ln_f, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return ln_f{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), ln_f, func>{e_(e)};
 		}
@@ -284,9 +369,9 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
-			return 1 / e_;
+			return lit<1>{} / e_;
 		}
 	};
 
@@ -302,24 +387,32 @@ namespace metamath
 	struct abs_f
 	{
 		template<typename T>
-		auto operator()(T v) const
+		constexpr auto operator()(T v) const
+		{
+			using cx::abs;
+			return abs(v);
+		}
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
 		{
-			return std::abs(v);
+			using cx::abs;
+			f = abs(v);
+			df = v / f;
 		}
 	};
 	
 	template<typename E>
 	struct exp<E, abs_f, func>
 	{
-		E e_;
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
 
 		template<typename V>
-		auto operator()(V v) const
+		constexpr auto operator()(V v) const
 		{
 			return abs_f{}(e_(v));
 		}
 		template<typename T1, typename T2, typename Op>
-		constexpr auto operator()(const exp<T1, T2, Op>& e)
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
 		{
 			return exp<decltype(e_(e)), abs_f, func>{e_(e)};
 		}
@@ -331,7 +424,7 @@ namespace metamath
 			return os;
 		}
 
-		auto derivative() const
+		constexpr auto derivative() const
 		{
 			return (e_) / (exp<E, abs_f, func>{e_});
 		}
@@ -343,6 +436,195 @@ namespace metamath
 			return exp<T, abs_f, func>{e};
 		}
 
+
+		// POLYNOMIAL
+
+	// c_[0] + c_[1] v + ... + c_[D] v^D, built by polynomial() (polynomial.h)
+	// the coefficients evaluate in const_t<C, V> like constants of type C,
+	// integer ones are stored as double (x / 2 has 0.5)
+	template<std::size_t D, typename C>
+	struct poly_f
+	{
+		typedef std::conditional_t<std::is_integral<C>::value, double, C> rtype;
+
+		// simd blocks of this degree and up use Estrin's scheme
+		static constexpr std::size_t estrin_degree = 4;
+
+		rtype c_[D + 1];
+
+		// Horner's scheme, D dependent multiply-adds, or Estrin's:
+		// the pairs c_[2i] + c_[2i+1] v are independent, then pairs of
+		// pairs in v^2, v^4, ..., only log2(D) steps depend on each other
+		template<typename T>
+		constexpr auto operator()(T v) const
+		{
+			return apply(v, std::integral_constant<int,
+				D == 0 ? 0 : is_block<T>::value && D >= estrin_degree ? 2 : 1>{});
+		}
+		// p and p' in one Horner pass
+		template<typename T>
+		constexpr void fused(T v, T& f, T& df) const
+		{
+			typedef const_t<C, T> K;
+			f = static_cast<K>(c_[D]);
+			df = T(0);
+			for (std::size_t i = D; i-- > 0;) {
+				df = df * v + f;
+				f = f * v + static_cast<K>(c_[i]);
+			}
+		}
+
+		constexpr poly_f<(D > 0 ? D - 1 : 0), C> derivative() const
+		{
+			poly_f<(D > 0 ? D - 1 : 0), C> r{};
+			for (std::size_t i = 1; i <= D; ++i)
+				r.c_[i - 1] = static_cast<rtype>(i) * c_[i];
+			return r;
+		}
+
+	private:
+		template<typename T>
+		constexpr const_t<C, T> apply(T, std::integral_constant<int, 0>) const
+		{
+			return static_cast<const_t<C, T>>(c_[0]);
+		}
+		template<typename T>
+		constexpr auto apply(T v, std::integral_constant<int, 1>) const
+		{
+			typedef const_t<C, T> K;
+			decltype(v * K() + K()) r = v * static_cast<K>(c_[D]) + static_cast<K>(c_[D - 1]);
+			for (std::size_t i = D - 1; i-- > 0;)
+				r = r * v + static_cast<K>(c_[i]);
+			return r;
+		}
+		template<typename T>
+		constexpr auto apply(T v, std::integral_constant<int, 2>) const
+		{
+			typedef const_t<C, T> K;
+			typedef decltype(v * K() + K()) R;
+			constexpr std::size_t L = levels(D + 1);
+			T w[L] = {v}; //v^(2^k)
+			for (std::size_t k = 1; k < L; ++k)
+				w[k] = w[k - 1] * w[k - 1];
+			return estrin<0, L>::template apply<K, R>(c_, w);
+		}
+
+		// halvings that bring n coefficients down to one
+		static constexpr std::size_t levels(std::size_t n)
+		{
+			return n <= 1 ? 0 : 1 + levels((n + 1) / 2);
+		}
+
+		// c_[I] + ... + c_[I + 2^L - 1] v^(2^L - 1), two halves joined by v^(2^(L-1))
+		template<std::size_t I, std::size_t L, bool = (I + (std::size_t(1) << (L - 1)) <= D)>
+		struct estrin
+		{
+			template<typename K, typename R, typename T>
+			static constexpr R apply(const rtype* c, const T* w)
+			{
+				return estrin<I + (std::size_t(1) << (L - 1)), L - 1>::template apply<K, R>(c, w) * w[L - 1] +
+					estrin<I, L - 1>::template apply<K, R>(c, w);
+			}
+		};
+		template<std::size_t I, std::size_t L>
+		struct estrin<I, L, false>
+		{
+			template<typename K, typename R, typename T>
+			static constexpr R apply(const rtype* c, const T* w)
+			{
+				return estrin<I, L - 1>::template apply<K, R>(c, w);
+			}
+		};
+		template<std::size_t I>
+		struct estrin<I, 1, true>
+		{
+			template<typename K, typename R, typename T>
+			static constexpr R apply(const rtype* c, const T* w)
+			{
+				return w[0] * static_cast<K>(c[I + 1]) + static_cast<K>(c[I]);
+			}
+		};
+		template<std::size_t I>
+		struct estrin<I, 1, false>
+		{
+			template<typename K, typename R, typename T>
+			static constexpr R apply(const rtype* c, const T*)
+			{
+				return R(static_cast<K>(c[I]));
+			}
+		};
+	};
+
+	template<typename E, std::size_t D, typename C>
+	struct exp<E, poly_f<D, C>, func>
+	{
+		METAMATH_NO_UNIQUE_ADDRESS E e_;
+		poly_f<D, C> f_;
+
+		template<typename V>
+		constexpr auto operator()(V v) const
+		{
+			return f_(e_(v));
+		}
+		template<typename T1, typename T2, typename Op>
+		constexpr auto operator()(const exp<T1, T2, Op>& e) const
+		{
+			return exp<decltype(e_(e)), poly_f<D, C>, func>{e_(e), f_};
+		}
+
+		template<typename Os>
+		Os& print(Os& os) const
+		{
+			os << "(";
+			bool first = true;
+			for (std::size_t i = 0; i <= D; ++i) {
+				const auto c = f_.c_[i];
+				if (c == 0)
+					continue;
+				if (!first)
+					os << (c < 0 ? " - " : " + ");
+				if (first && c < 0)
+					os << "-";
+				const auto a = c < 0 ? -c : c;
+				if (i == 0 || a != 1)
+					os << a << (i > 0 ? " * " : "");
+				if (i == 1)
+					os << e_;
+				else if (i > 1)
+					os << "(" << e_ << ")^" << i;
+				first = false;
+			}
+			if (first)
+				os << "0";
+			os << ")";
+			return os;
+		}
+
+		constexpr auto derivative() const
+		{
+			return derive(std::integral_constant<bool, D == 0>{});
+		}
+
+	private:
+		constexpr lit<0> derive(std::true_type) const
+		{
+			return {};
+		}
+		constexpr exp<E, poly_f<(D > 0 ? D - 1 : 0), C>, func> derive(std::false_type) const
+		{
+			return {e_, f_.derivative()};
+		}
+	};
+
+
+	// layout: a function node is its argument
+	static_assert(sizeof(exp<exp<float, empty, constant>, sin_f, func>) == sizeof(float), "function layout");
+	static_assert(sizeof(exp<exp<float, empty, constant>, pow_f<3>, func>) == sizeof(float), "function layout");
+	static_assert(sizeof(exp<var<domain>, poly_f<2, float>, func>) == (METAMATH_COMPACT_LAYOUT ? 3 : 4) * sizeof(float),
+		"polynomial layout");
+#if METAMATH_COMPACT_LAYOUT
+	static_assert(std::is_empty<exp<var<domain>, sin_f, func>>::value, "function layout");
+#endif
 }
 
 #endif
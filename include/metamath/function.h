@@ -0,0 +1,293 @@
+#ifndef H_B3EFAF850FA84CAC899F22787D8E70AE
+#define H_B3EFAF850FA84CAC899F22787D8E70AE
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "batch.h"
+
+namespace metamath
+{
+	// a handle of any expression of one variable, function<double(double)>,
+	// with an optional derivative carried alongside
+	//
+	// the expression (and its derivative) is stored in a Size-byte buffer
+	// of the handle when it fits, on the heap otherwise; the default handle
+	// is one 64-byte cache line
+	//
+	template<typename Sig, std::size_t Size = 48>
+	struct function;
+
+	namespace erased
+	{
+		// no derivative carried
+		struct none
+		{
+		};
+
+		// the stored expression and its derivative
+		template<typename E, typename D>
+		struct pair
+		{
+			METAMATH_NO_UNIQUE_ADDRESS E e_;
+			METAMATH_NO_UNIQUE_ADDRESS D d_;
+		};
+
+		template<typename Obj, std::size_t Size>
+		struct fits
+			:std::integral_constant<bool, sizeof(Obj) <= Size
+				&& alignof(Obj) <= alignof(std::max_align_t)
+				&& std::is_nothrow_move_constructible<Obj>::value>
+		{
+		};
+
+		// the object is in the buffer
+		template<typename Obj>
+		struct local
+		{
+			static constexpr bool inplace = true;
+
+			static const Obj& get(const void* p)
+			{
+				return *static_cast<const Obj*>(p);
+			}
+			static void create(void* p, const Obj& o)
+			{
+				::new (p) Obj(o);
+			}
+			static void copy(const void* from, void* to)
+			{
+				::new (to) Obj(get(from));
+			}
+			static void move(void* from, void* to)
+			{
+				Obj* o = static_cast<Obj*>(from);
+				::new (to) Obj(std::move(*o));
+				o->~Obj();
+			}
+			static void destroy(void* p)
+			{
+				static_cast<Obj*>(p)->~Obj();
+			}
+		};
+
+		// the object is on the heap, the buffer holds the pointer
+		template<typename Obj>
+		struct remote
+		{
+			static constexpr bool inplace = false;
+
+			static const Obj& get(const void* p)
+			{
+				return **static_cast<Obj* const*>(p);
+			}
+			static void create(void* p, const Obj& o)
+			{
+				::new (p) Obj*(new Obj(o));
+			}
+			static void copy(const void* from, void* to)
+			{
+				create(to, get(from));
+			}
+			static void move(void* from, void* to)
+			{
+				::new (to) Obj*(*static_cast<Obj**>(from));
+			}
+			static void destroy(void* p)
+			{
+				delete *static_cast<Obj**>(p);
+			}
+		};
+
+		// the operations of one stored type, a handle points to one table
+		template<typename R, typename A, std::size_t Size>
+		struct table
+		{
+			R (*call_)(const void*, A);
+			void (*evaluate_)(const void*, const A*, R*, std::size_t);
+			void (*derivative_)(const void*, function<R(A), Size>&);
+			void (*copy_)(const void*, void*);
+			void (*move_)(void*, void*); //leaves the source destroyed
+			void (*destroy_)(void*);
+			bool inplace_;
+			bool derivative_carried_;
+		};
+
+		template<typename R, typename A, std::size_t Size, typename E, typename D>
+		struct model
+		{
+			typedef pair<E, D> obj;
+			typedef std::conditional_t<fits<obj, Size>::value, local<obj>, remote<obj>> store;
+
+			// a one-lane block, so the point is evaluated in A (a scalar argument
+			// would take the domain of the variable, float for x)
+			static R call(const void* p, A a)
+			{
+				R r;
+				simd::store<1>(store::get(p).e_(simd::pack<A, 1>::load(&a)), &r);
+				return r;
+			}
+			// the whole array goes through the simd blocks of batch.h
+			static void eval(const void* p, const A* in, R* out, std::size_t n)
+			{
+				evaluate(store::get(p).e_, in, out, n);
+			}
+			static void derive(const void* p, function<R(A), Size>& f)
+			{
+				assign(f, store::get(p).d_);
+			}
+
+			static const table<R, A, Size> table_;
+
+		private:
+			// the derivative handle does not carry a derivative of its own
+			template<typename F, typename U>
+			static void assign(F& f, const U& d)
+			{
+				f = F(d);
+			}
+			template<typename F>
+			static void assign(F& f, none)
+			{
+				f = F();
+			}
+		};
+
+		template<typename R, typename A, std::size_t Size, typename E, typename D>
+		const table<R, A, Size> model<R, A, Size, E, D>::table_ = {
+			&call, &eval, &derive, &store::copy, &store::move, &store::destroy,
+			store::inplace, !std::is_same<D, none>::value
+		};
+	}
+
+	template<typename R, typename A, std::size_t Size>
+	struct function<R(A), Size>
+	{
+		typedef R type;
+		static constexpr std::size_t size = Size;
+
+		// empty, it must not be called
+		function() = default;
+
+		template<typename E, typename = std::enable_if_t<!std::is_same<std::decay_t<E>, function>::value>>
+		function(const E& e)
+			:function(e, erased::none{})
+		{
+		}
+		// e and its derivative d, d is not checked against e
+		template<typename E, typename D>
+		function(const E& e, const D& d)
+		{
+			typedef erased::model<R, A, Size, E, D> m;
+			m::store::create(buf_, {e, d});
+			t_ = &m::table_;
+		}
+
+		function(const function& f)
+		{
+			if (f.t_)
+				f.t_->copy_(f.buf_, buf_);
+			t_ = f.t_;
+		}
+		function(function&& f) noexcept
+		{
+			take(f);
+		}
+		function& operator=(const function& f)
+		{
+			if (this != &f) {
+				function c(f);
+				reset();
+				take(c);
+			}
+			return *this;
+		}
+		function& operator=(function&& f) noexcept
+		{
+			if (this != &f) {
+				reset();
+				take(f);
+			}
+			return *this;
+		}
+		~function()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			if (t_) {
+				t_->destroy_(buf_);
+				t_ = nullptr;
+			}
+		}
+
+		explicit operator bool() const
+		{
+			return t_ != nullptr;
+		}
+		// the expression is in the handle, no heap allocation
+		bool inplace() const
+		{
+			return t_ && t_->inplace_;
+		}
+		bool has_derivative() const
+		{
+			return t_ && t_->derivative_carried_;
+		}
+
+		// one indirect call per point
+		R operator()(A a) const
+		{
+			return t_->call_(buf_, a);
+		}
+		// one indirect call per array: out[i] = f(in[i]), i = [0, n)
+		void evaluate(const A* in, R* out, std::size_t n) const
+		{
+			t_->evaluate_(buf_, in, out, n);
+		}
+
+		// a handle of the carried derivative, empty if there is none
+		function derivative() const
+		{
+			function r;
+			if (t_)
+				t_->derivative_(buf_, r);
+			return r;
+		}
+
+	private:
+		alignas(std::max_align_t) unsigned char buf_[Size];
+		const erased::table<R, A, Size>* t_ = nullptr;
+
+		void take(function& f) noexcept
+		{
+			if (f.t_)
+				f.t_->move_(f.buf_, buf_);
+			t_ = f.t_;
+			f.t_ = nullptr;
+		}
+	};
+
+	// batch evaluation of a handle, see batch.h
+	template<typename R, typename A, std::size_t Size>
+	void evaluate(const function<R(A), Size>& f, const A* in, R* out, std::size_t n)
+	{
+		f.evaluate(in, out, n);
+	}
+	template<typename A, std::size_t Size>
+	void evaluate(const function<A(A), Size>& f, A* inout, std::size_t n)
+	{
+		f.evaluate(inout, inout, n);
+	}
+
+	template<typename R, typename A, std::size_t Size>
+	function<R(A), Size> derivative(const function<R(A), Size>& f)
+	{
+		return f.derivative();
+	}
+}
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef H_F38DD98A3D444863909E9D7840C9B950
+#define H_F38DD98A3D444863909E9D7840C9B950
+
+#include <cstddef>
+#include "func.h"
+
+namespace metamath
+{
+	// reverse-mode (adjoint) evaluation
+	// adj<E, T> mirrors the expression tree of type E and keeps the
+	// intermediate values of the forward sweep the backward sweep needs
+	template<typename E, typename T>
+		struct adj;
+
+	// constants and parameters
+	template<typename C, typename T>
+		struct adj<exp<C, empty, constant>, T>
+		{
+			typedef exp<C, empty, constant> cexp;
+
+			template<typename P>
+			T forward(const cexp& e, const P& p)
+			{
+				return static_cast<T>(e(p));
+			}
+			template<typename G>
+			void backward(const cexp&, T, G&)
+			{
+			}
+		};
+	template<typename C, typename T>
+		struct adj<exp<C, empty, parameter>, T>
+		{
+			typedef exp<C, empty, parameter> pexp;
+
+			template<typename P>
+			T forward(const pexp& e, const P& p)
+			{
+				return static_cast<T>(e(p));
+			}
+			template<typename G>
+			void backward(const pexp&, T, G&)
+			{
+			}
+		};
+	template<int N, typename T>
+		struct adj<lit<N>, T>
+		{
+			template<typename P>
+			T forward(const lit<N>&, const P&)
+			{
+				return static_cast<T>(N);
+			}
+			template<typename G>
+			void backward(const lit<N>&, T, G&)
+			{
+			}
+		};
+
+	// variables collect the adjoints into their gradient slot
+	template<typename D, typename Tag, typename T>
+		struct adj<exp<D, Tag, variable>, T>
+		{
+			typedef exp<D, Tag, variable> vexp;
+
+			template<typename P>
+			T forward(const vexp& e, const P& p)
+			{
+				return e(p);
+			}
+			template<typename G>
+			void backward(const vexp& e, T a, G& g)
+			{
+				g.v_[e.index] += a;
+			}
+		};
+
+	template<typename E1, typename E2, typename T>
+		struct adj<exp<E1, E2, plus>, T>
+		{
+			typedef exp<E1, E2, plus> pexp;
+
+			adj<E1, T> l_;
+			adj<E2, T> r_;
+
+			template<typename P>
+			T forward(const pexp& e, const P& p)
+			{
+				return l_.forward(e.e1_, p) + r_.forward(e.e2_, p);
+			}
+			template<typename G>
+			void backward(const pexp& e, T a, G& g)
+			{
+				l_.backward(e.e1_, a, g);
+				r_.backward(e.e2_, a, g);
+			}
+		};
+
+	template<typename E1, typename E2, typename T>
+		struct adj<exp<E1, E2, minus>, T>
+		{
+			typedef exp<E1, E2, minus> mexp;
+
+			adj<E1, T> l_;
+			adj<E2, T> r_;
+
+			template<typename P>
+			T forward(const mexp& e, const P& p)
+			{
+				return l_.forward(e.e1_, p) - r_.forward(e.e2_, p);
+			}
+			template<typename G>
+			void backward(const mexp& e, T a, G& g)
+			{
+				l_.backward(e.e1_, a, g);
+				r_.backward(e.e2_, -a, g);
+			}
+		};
+
+	template<typename E1, typename E2, typename T>
+		struct adj<exp<E1, E2, mult>, T>
+		{
+			typedef exp<E1, E2, mult> mexp;
+
+			adj<E1, T> l_;
+			adj<E2, T> r_;
+			T lv_;
+			T rv_;
+
+			template<typename P>
+			T forward(const mexp& e, const P& p)
+			{
+				lv_ = l_.forward(e.e1_, p);
+				rv_ = r_.forward(e.e2_, p);
+				return lv_ * rv_;
+			}
+			template<typename G>
+			void backward(const mexp& e, T a, G& g)
+			{
+				l_.backward(e.e1_, a * rv_, g);
+				r_.backward(e.e2_, a * lv_, g);
+			}
+		};
+
+	template<typename E1, typename E2, typename T>
+		struct adj<exp<E1, E2, div>, T>
+		{
+			typedef exp<E1, E2, div> dexp;
+
+			adj<E1, T> l_;
+			adj<E2, T> r_;
+			T rv_; //divisor
+			T v_;  //quotient
+
+			template<typename P>
+			T forward(const dexp& e, const P& p)
+			{
+				T lv = l_.forward(e.e1_, p);
+				rv_ = r_.forward(e.e2_, p);
+				v_ = lv / rv_;
+				return v_;
+			}
+			template<typename G>
+			void backward(const dexp& e, T a, G& g)
+			{
+				T q = a / rv_;
+				l_.backward(e.e1_, q, g);
+				r_.backward(e.e2_, -q * v_, g);
+			}
+		};
+
+	template<typename E, typename T>
+		struct adj<exp<E, empty, negate>, T>
+		{
+			typedef exp<E, empty, negate> nexp;
+
+			adj<E, T> c_;
+
+			template<typename P>
+			T forward(const nexp& e, const P& p)
+			{
+				return -c_.forward(e.e_, p);
+			}
+			template<typename G>
+			void backward(const nexp& e, T a, G& g)
+			{
+				c_.backward(e.e_, -a, g);
+			}
+		};
+
+	// functions keep the derivative from their fused kernel
+	template<typename E, typename F, typename T>
+		struct adj<exp<E, F, func>, T>
+		{
+			typedef exp<E, F, func> fexp;
+
+			adj<E, T> c_;
+			T df_;
+
+			template<typename P>
+			T forward(const fexp& e, const P& p)
+			{
+				T f;
+				F{}.fused(c_.forward(e.e_, p), f, df_);
+				return f;
+			}
+			template<typename G>
+			void backward(const fexp& e, T a, G& g)
+			{
+				c_.backward(e.e_, a * df_, g);
+			}
+		};
+
+	// polynomials carry their coefficients
+	template<typename E, std::size_t D, typename C, typename T>
+		struct adj<exp<E, poly_f<D, C>, func>, T>
+		{
+			typedef exp<E, poly_f<D, C>, func> fexp;
+
+			adj<E, T> c_;
+			T df_;
+
+			template<typename P>
+			T forward(const fexp& e, const P& p)
+			{
+				T f;
+				e.f_.fused(c_.forward(e.e_, p), f, df_);
+				return f;
+			}
+			template<typename G>
+			void backward(const fexp& e, T a, G& g)
+			{
+				c_.backward(e.e_, a * df_, g);
+			}
+		};
+
+	// f(p) and all partial derivatives g[i] = df/dv_i
+	// in one forward and one backward sweep
+	template<typename E, typename T, std::size_t N>
+		T gradient(const E& e, const point<T, N>& p, point<T, N>& g)
+		{
+			adj<E, T> t;
+			T v = t.forward(e, p);
+			g = point<T, N>{};
+			t.backward(e, T(1), g);
+			return v;
+		}
+
+	template<typename E, typename T, std::size_t N>
+		point<T, N> gradient(const E& e, const point<T, N>& p)
+		{
+			point<T, N> g;
+			gradient(e, p, g);
+			return g;
+		}
+}
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef H_60C54860BBC740CB9874E81AE38D4719
+#define H_60C54860BBC740CB9874E81AE38D4719
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "batch.h"
+#include "cost.h"
+
+namespace metamath
+{
+	// values of an expression with parameters at fixed points, kept up to
+	// date as the parameters change
+	//
+	// the cache mirrors the expression tree, each node is one of
+	//   scalar  no variable (parameters, constants and what is built of
+	//           them): evaluated again on every update, changed if its
+	//           value differs from the last one
+	//   fixed   variables, no parameter: a column of n values, evaluated
+	//           once with evaluate()
+	//   live    variables and parameters: a column of n values, recomputed
+	//           from the columns of its operands when one of them changed
+	//
+	// so an update only recomputes the nodes on the paths from the changed
+	// parameters to the root, each as one loop over the n points; memory is
+	// a column per fixed and live node
+	namespace inc
+	{
+		template<typename E>
+		struct has_param : std::false_type {};
+		template<typename T>
+		struct has_param<exp<T, empty, parameter>> : std::true_type {};
+		template<typename E, typename F>
+		struct has_param<exp<E, F, func>> : has_param<E> {};
+		template<typename E>
+		struct has_param<exp<E, empty, negate>> : has_param<E> {};
+		template<typename E1, typename E2, typename Op>
+		struct has_param<exp<E1, E2, Op>>
+			: std::integral_constant<bool, has_param<E1>::value || has_param<E2>::value> {};
+
+		template<typename E, typename T>
+		struct scalar;
+		template<typename E, typename T>
+		struct fixed;
+		template<typename E, typename T, typename = void>
+		struct live;
+
+		template<typename E, typename T>
+		using node = std::conditional_t<!costs::has_var<E>::value, scalar<E, T>,
+			std::conditional_t<!has_param<E>::value, fixed<E, T>, live<E, T>>>;
+
+		// init() computes the node, update() recomputes what changed since,
+		// both return whether the values of the node changed; k counts the
+		// columns computed
+
+		template<typename E, typename T>
+		struct scalar
+		{
+			T s_;
+
+			bool init(const E& e, const T*, std::size_t, std::size_t&)
+			{
+				s_ = static_cast<T>(e(T{}));
+				return true;
+			}
+			bool update(const E& e, std::size_t, std::size_t&)
+			{
+				const T s = static_cast<T>(e(T{}));
+				const bool changed = !(s == s_); //also NaN
+				s_ = s;
+				return changed;
+			}
+			T at(std::size_t) const
+			{
+				return s_;
+			}
+		};
+
+		template<typename E, typename T>
+		struct fixed
+		{
+			std::vector<T> v_;
+
+			bool init(const E& e, const T* in, std::size_t n, std::size_t& k)
+			{
+				v_.resize(n);
+				evaluate(e, in, v_.data(), n);
+				++k;
+				return true;
+			}
+			bool update(const E&, std::size_t, std::size_t&)
+			{
+				return false;
+			}
+			T at(std::size_t i) const
+			{
+				return v_[i];
+			}
+		};
+
+		// the operation of a node on values
+		template<typename Op>
+		struct binary;
+		template<>
+		struct binary<plus>
+		{
+			template<typename T>
+			static T apply(T a, T b)
+			{
+				return a + b;
+			}
+		};
+		template<>
+		struct binary<minus>
+		{
+			template<typename T>
+			static T apply(T a, T b)
+			{
+				return a - b;
+			}
+		};
+		template<>
+		struct binary<mult>
+		{
+			template<typename T>
+			static T apply(T a, T b)
+			{
+				return a * b;
+			}
+		};
+		template<>
+		struct binary<div>
+		{
+			template<typename T>
+			static T apply(T a, T b)
+			{
+				return a / b;
+			}
+		};
+
+		template<typename E, typename F>
+		F functor(const exp<E, F, func>&)
+		{
+			return {};
+		}
+		template<typename E, std::size_t D, typename C>
+		const poly_f<D, C>& functor(const exp<E, poly_f<D, C>, func>& e)
+		{
+			return e.f_;
+		}
+
+		template<typename E1, typename E2, typename Op, typename T>
+		struct live<exp<E1, E2, Op>, T, std::enable_if_t<is_binary_op<Op>::value>>
+		{
+			typedef exp<E1, E2, Op> bexp;
+
+			node<E1, T> l_;
+			node<E2, T> r_;
+			std::vector<T> v_;
+
+			bool init(const bexp& e, const T* in, std::size_t n, std::size_t& k)
+			{
+				l_.init(e.e1_, in, n, k);
+				r_.init(e.e2_, in, n, k);
+				v_.resize(n);
+				compute(n, k);
+				return true;
+			}
+			bool update(const bexp& e, std::size_t n, std::size_t& k)
+			{
+				const bool l = l_.update(e.e1_, n, k);
+				const bool r = r_.update(e.e2_, n, k);
+				if (!l && !r)
+					return false;
+				compute(n, k);
+				return true;
+			}
+			T at(std::size_t i) const
+			{
+				return v_[i];
+			}
+
+		private:
+			void compute(std::size_t n, std::size_t& k)
+			{
+				for (std::size_t i = 0; i < n; ++i)
+					v_[i] = binary<Op>::apply(l_.at(i), r_.at(i));
+				++k;
+			}
+		};
+
+		template<typename E, typename T>
+		struct live<exp<E, empty, negate>, T>
+		{
+			typedef exp<E, empty, negate> nexp;
+
+			node<E, T> a_;
+			std::vector<T> v_;
+
+			bool init(const nexp& e, const T* in, std::size_t n, std::size_t& k)
+			{
+				a_.init(e.e_, in, n, k);
+				v_.resize(n);
+				compute(n, k);
+				return true;
+			}
+			bool update(const nexp& e, std::size_t n, std::size_t& k)
+			{
+				if (!a_.update(e.e_, n, k))
+					return false;
+				compute(n, k);
+				return true;
+			}
+			T at(std::size_t i) const
+			{
+				return v_[i];
+			}
+
+		private:
+			void compute(std::size_t n, std::size_t& k)
+			{
+				for (std::size_t i = 0; i < n; ++i)
+					v_[i] = -a_.at(i);
+				++k;
+			}
+		};
+
+		template<typename E, typename F, typename T>
+		struct live<exp<E, F, func>, T>
+		{
+			typedef exp<E, F, func> fexp;
+
+			node<E, T> a_;
+			std::vector<T> v_;
+
+			bool init(const fexp& e, const T* in, std::size_t n, std::size_t& k)
+			{
+				a_.init(e.e_, in, n, k);
+				v_.resize(n);
+				compute(e, n, k);
+				return true;
+			}
+			bool update(const fexp& e, std::size_t n, std::size_t& k)
+			{
+				if (!a_.update(e.e_, n, k))
+					return false;
+				compute(e, n, k);
+				return true;
+			}
+			T at(std::size_t i) const
+			{
+				return v_[i];
+			}
+
+		private:
+			void compute(const fexp& e, std::size_t n, std::size_t& k)
+			{
+				const auto f = functor(e);
+				for (std::size_t i = 0; i < n; ++i)
+					v_[i] = static_cast<T>(f(a_.at(i)));
+				++k;
+			}
+		};
+	}
+
+	// e(in[i]), i = [0, n), for points fixed at construction:
+	//
+	//   param<double> a("a", 1);
+	//   const var<double> t;
+	//   auto f = Param(a) * Sin(t) + Exp(-t);
+	//   auto c = cache(f, in, n);     //all columns
+	//   a = 2;
+	//   c.update();                   //Param(a) * Sin(t) and the sum
+	//   c[i]
+	//
+	template<typename E, typename T>
+	struct incremental
+	{
+		E e_;
+		inc::node<E, T> root_;
+		std::size_t n_;
+		std::size_t computed_ = 0;
+
+		incremental(const E& e, const T* in, std::size_t n)
+			:e_{e}, n_{n}
+		{
+			root_.init(e_, in, n_, computed_);
+		}
+
+		// brings the values up to date with the parameters
+		void update()
+		{
+			computed_ = 0;
+			root_.update(e_, n_, computed_);
+		}
+
+		// columns (of n values) computed by the last update, or by the construction
+		std::size_t computed() const
+		{
+			return computed_;
+		}
+		std::size_t size() const
+		{
+			return n_;
+		}
+		T operator[](std::size_t i) const
+		{
+			return root_.at(i);
+		}
+		void copy(T* out) const
+		{
+			for (std::size_t i = 0; i < n_; ++i)
+				out[i] = root_.at(i);
+		}
+	};
+
+	template<typename T, typename E>
+	incremental<E, T> cache(const E& e, const T* in, std::size_t n)
+	{
+		return {e, in, n};
+	}
+}
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef H_D7D925B4CEC34835BFB0623BA7B13177
+#define H_D7D925B4CEC34835BFB0623BA7B13177
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include "batch.h"
+
+namespace metamath
+{
+	// mixed precision: an expression runs in float, twice the simd lanes of
+	// double, with a running bound of the absolute error of every node
+	// (first order, rounding to nearest):
+	//
+	//   a + b, a - b   ea + eb + u |r|
+	//   a * b          |a| eb + |b| ea + ea eb + u |r|
+	//   a / b          (ea + |r| eb) / |b| + u |r|
+	//   sqrt a         ea / (2 r) + u r
+	//   exp a          r (ea + 2u)
+	//   ln a           ea / |a| + 2u |r|
+	//   sin a, cos a   ea + 2u |r|
+	//   -a, |a|        ea
+	//
+	// u is the unit roundoff of float, the functions are taken as 1 ulp
+	// accurate; double inputs and constants start with their rounding error.
+	// Cancellation in a - b or a division by an inexact small number shows up
+	// as a bound large against |r|, and only those points are evaluated again
+	// in double.
+	namespace mixed
+	{
+		template<typename U>
+		using if_scalar = std::enable_if_t<std::is_arithmetic<U>::value>;
+
+		// unit roundoff
+		template<typename T>
+		constexpr T unit()
+		{
+			return std::numeric_limits<T>::epsilon() / 2;
+		}
+
+		// a value and the bound of its absolute error,
+		// the func.h functors find its sin, cos, exp, log, sqrt and abs through ADL
+		template<typename T>
+		struct num
+		{
+			typedef T type;
+
+			T v_;
+			T e_;
+
+			num() = default;
+			constexpr num(T v, T e)
+				:v_{v}, e_{e}
+			{
+			}
+			// a constant, with the error of its rounding
+			template<typename U, typename = if_scalar<U>>
+			METAMATH_KERNEL num(U v)
+				:v_{static_cast<T>(v)}
+				, e_{static_cast<T>(std::abs(static_cast<double>(v) - static_cast<double>(static_cast<T>(v))))}
+			{
+			}
+		};
+
+		// N points at once, values and bounds in separate arrays
+		// so that the lane loops vectorize
+		template<typename T, std::size_t N>
+		struct block
+		{
+			typedef T type;
+			static constexpr std::size_t size = N;
+
+			T v_[N];
+			T e_[N];
+		};
+
+		// the rules above, on one value and bound: r and e receive the result
+		template<typename T>
+		struct rule
+		{
+			static METAMATH_KERNEL void add(T a, T ea, T b, T eb, T& r, T& e)
+			{
+				r = a + b;
+				e = ea + eb + unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void sub(T a, T ea, T b, T eb, T& r, T& e)
+			{
+				r = a - b;
+				e = ea + eb + unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void mul(T a, T ea, T b, T eb, T& r, T& e)
+			{
+				r = a * b;
+				e = std::abs(a) * eb + std::abs(b) * ea + ea * eb + unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void div(T a, T ea, T b, T eb, T& r, T& e)
+			{
+				r = a / b;
+				e = (ea + std::abs(r) * eb) / std::abs(b) + unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void neg(T a, T ea, T& r, T& e)
+			{
+				r = -a;
+				e = ea;
+			}
+			static METAMATH_KERNEL void sqrt(T a, T ea, T& r, T& e)
+			{
+				r = std::sqrt(a);
+				e = ea / (r + r) + unit<T>() * r;
+			}
+			static METAMATH_KERNEL void exp(T a, T ea, T& r, T& e)
+			{
+				r = std::exp(a);
+				e = r * (ea + 2 * unit<T>());
+			}
+			static METAMATH_KERNEL void log(T a, T ea, T& r, T& e)
+			{
+				r = std::log(a);
+				e = ea / std::abs(a) + 2 * unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void sin(T a, T ea, T& r, T& e)
+			{
+				r = std::sin(a);
+				e = ea + 2 * unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void cos(T a, T ea, T& r, T& e)
+			{
+				r = std::cos(a);
+				e = ea + 2 * unit<T>() * std::abs(r);
+			}
+			static METAMATH_KERNEL void abs(T a, T ea, T& r, T& e)
+			{
+				r = std::abs(a);
+				e = ea;
+			}
+		};
+
+		// num and block with each other's kind or with a scalar constant,
+		// which is rounded once
+#define METAMATH_MIXED_OP(OP, RULE) \
+		template<typename T> \
+		METAMATH_KERNEL num<T> operator OP(const num<T>& a, const num<T>& b) \
+		{ \
+			num<T> r; \
+			rule<T>::RULE(a.v_, a.e_, b.v_, b.e_, r.v_, r.e_); \
+			return r; \
+		} \
+		template<typename T, typename U, typename = if_scalar<U>> \
+		METAMATH_KERNEL num<T> operator OP(const num<T>& a, U b) \
+		{ \
+			return a OP num<T>(b); \
+		} \
+		template<typename U, typename T, typename = if_scalar<U>> \
+		METAMATH_KERNEL num<T> operator OP(U a, const num<T>& b) \
+		{ \
+			return num<T>(a) OP b; \
+		} \
+		template<typename T, std::size_t N> \
+		METAMATH_KERNEL block<T, N> operator OP(const block<T, N>& a, const block<T, N>& b) \
+		{ \
+			block<T, N> r; \
+			for (std::size_t i = 0; i < N; ++i) \
+				rule<T>::RULE(a.v_[i], a.e_[i], b.v_[i], b.e_[i], r.v_[i], r.e_[i]); \
+			return r; \
+		} \
+		template<typename T, std::size_t N, typename U, typename = if_scalar<U>> \
+		METAMATH_KERNEL block<T, N> operator OP(const block<T, N>& a, U s) \
+		{ \
+			const num<T> b(s); \
+			block<T, N> r; \
+			for (std::size_t i = 0; i < N; ++i) \
+				rule<T>::RULE(a.v_[i], a.e_[i], b.v_, b.e_, r.v_[i], r.e_[i]); \
+			return r; \
+		} \
+		template<typename U, typename T, std::size_t N, typename = if_scalar<U>> \
+		METAMATH_KERNEL block<T, N> operator OP(U s, const block<T, N>& b) \
+		{ \
+			const num<T> a(s); \
+			block<T, N> r; \
+			for (std::size_t i = 0; i < N; ++i) \
+				rule<T>::RULE(a.v_, a.e_, b.v_[i], b.e_[i], r.v_[i], r.e_[i]); \
+			return r; \
+		}
+
+		METAMATH_MIXED_OP(+, add)
+		METAMATH_MIXED_OP(-, sub)
+		METAMATH_MIXED_OP(*, mul)
+		METAMATH_MIXED_OP(/, div)
+
+#undef METAMATH_MIXED_OP
+
+#define METAMATH_MIXED_FUNC(NAME, RULE) \
+		template<typename T> \
+		METAMATH_KERNEL num<T> NAME(const num<T>& a) \
+		{ \
+			num<T> r; \
+			rule<T>::RULE(a.v_, a.e_, r.v_, r.e_); \
+			return r; \
+		} \
+		template<typename T, std::size_t N> \
+		METAMATH_KERNEL block<T, N> NAME(const block<T, N>& a) \
+		{ \
+			block<T, N> r; \
+			for (std::size_t i = 0; i < N; ++i) \
+				rule<T>::RULE(a.v_[i], a.e_[i], r.v_[i], r.e_[i]); \
+			return r; \
+		}
+
+		METAMATH_MIXED_FUNC(operator-, neg)
+		METAMATH_MIXED_FUNC(sqrt, sqrt)
+		METAMATH_MIXED_FUNC(exp, exp)
+		METAMATH_MIXED_FUNC(log, log)
+		METAMATH_MIXED_FUNC(sin, sin)
+		METAMATH_MIXED_FUNC(cos, cos)
+		METAMATH_MIXED_FUNC(abs, abs)
+
+#undef METAMATH_MIXED_FUNC
+
+		// a double rounded to float, with its error
+		inline num<float> in(double v)
+		{
+			const float f = static_cast<float>(v);
+			return {f, static_cast<float>(std::abs(v - f))};
+		}
+
+		// points evaluated per pass, the flagged ones are then evaluated together in double
+		static constexpr std::size_t chunk = 256;
+
+		// writes the values, appends the indices of those off the tolerance to redo
+		template<std::size_t N, typename T>
+		std::size_t keep_lanes(const T* v, const T* e, T abs_tol, T rel_tol,
+			double* out, std::size_t i, std::uint32_t* redo, std::size_t k)
+		{
+			// most blocks have no flagged lane
+			bool any = false;
+			for (std::size_t j = 0; j < N; ++j) {
+				out[i + j] = v[j];
+				any |= !(e[j] <= abs_tol + rel_tol * std::abs(v[j])); //also NaN
+			}
+			if (any) {
+				for (std::size_t j = 0; j < N; ++j) {
+					if (!(e[j] <= abs_tol + rel_tol * std::abs(v[j])))
+						redo[k++] = static_cast<std::uint32_t>(i + j);
+				}
+			}
+			return k;
+		}
+		template<std::size_t N, typename T>
+		std::size_t keep(const block<T, N>& r, T abs_tol, T rel_tol,
+			double* out, std::size_t i, std::uint32_t* redo, std::size_t k)
+		{
+			return keep_lanes<N>(r.v_, r.e_, abs_tol, rel_tol, out, i, redo, k);
+		}
+		template<std::size_t N, typename T>
+		std::size_t keep(const num<T>& r, T abs_tol, T rel_tol,
+			double* out, std::size_t i, std::uint32_t* redo, std::size_t k)
+		{
+			return keep_lanes<1>(&r.v_, &r.e_, abs_tol, rel_tol, out, i, redo, k);
+		}
+		// an expression without variables, all in double
+		template<std::size_t N, typename U, typename T, typename = if_scalar<U>>
+		std::size_t keep(U, T, T, double*, std::size_t i, std::uint32_t* redo, std::size_t k)
+		{
+			for (std::size_t j = 0; j < N; ++j)
+				redo[k++] = static_cast<std::uint32_t>(i + j);
+			return k;
+		}
+
+		// evaluates in[i, i + N) in float
+		template<std::size_t N, typename E>
+		std::size_t points(const E& e, const double* in, double* out, std::size_t i,
+			float abs_tol, float rel_tol, std::uint32_t* redo, std::size_t k)
+		{
+			block<float, N> a;
+			for (std::size_t j = 0; j < N; ++j) {
+				a.v_[j] = static_cast<float>(in[i + j]);
+				a.e_[j] = static_cast<float>(std::abs(in[i + j] - a.v_[j]));
+			}
+			return keep<N>(e(a), abs_tol, rel_tol, out, i, redo, k);
+		}
+		template<typename E>
+		std::size_t point(const E& e, const double* in, double* out, std::size_t i,
+			float abs_tol, float rel_tol, std::uint32_t* redo, std::size_t k)
+		{
+			return keep<1>(e(mixed::in(in[i])), abs_tol, rel_tol, out, i, redo, k);
+		}
+	}
+
+	template<typename T, std::size_t N>
+	struct is_block<mixed::block<T, N>> : std::true_type {};
+
+	struct mixed_options
+	{
+		double abs_tol_ = 0;
+		double rel_tol_ = 1e-5; //of |f(x)|, about 80 float ulps
+	};
+
+	// out[i] = e(in[i]), i = [0, n), evaluated in float simd blocks; the points
+	// whose error bound exceeds abs_tol_ + rel_tol_ |f(x)| are evaluated again,
+	// together, in double. Returns the number of those points.
+	template<typename E>
+	std::size_t evaluate_mixed(const E& e, const double* in, double* out, std::size_t n,
+		const mixed_options& o = mixed_options{})
+	{
+		constexpr std::size_t N = simd::lanes<float>::value;
+		const float abs_tol = static_cast<float>(o.abs_tol_);
+		const float rel_tol = static_cast<float>(o.rel_tol_);
+
+		std::uint32_t redo[mixed::chunk];
+		double x[mixed::chunk];
+		double y[mixed::chunk];
+		std::size_t total = 0;
+		for (std::size_t c = 0; c < n; c += mixed::chunk) {
+			const std::size_t m = n - c < mixed::chunk ? n - c : mixed::chunk;
+			std::size_t k = 0;
+			std::size_t i = 0;
+			for (; i + N <= m; i += N)
+				k = mixed::points<N>(e, in + c, out + c, i, abs_tol, rel_tol, redo, k);
+			for (; i < m; ++i)
+				k = mixed::point(e, in + c, out + c, i, abs_tol, rel_tol, redo, k);
+
+				// all in double: evaluate() runs its blocks and its tail in the element type
+			for (std::size_t j = 0; j < k; ++j)
+				x[j] = in[c + redo[j]];
+			evaluate(e, x, y, k);
+			for (std::size_t j = 0; j < k; ++j)
+				out[c + redo[j]] = y[j];
+			total += k;
+		}
+		return total;
+	}
+
+	// the float value of e(v) and its error bound, e.g. to see where the
+	// bound of an expression grows
+	template<typename E>
+	mixed::num<float> bounded(const E& e, double v)
+	{
+		return e(mixed::in(v));
+	}
+}
+
+#endif
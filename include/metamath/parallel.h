@@ -0,0 +1,227 @@
+#ifndef H_EAF2F30172644419A0A1B3EEF97603A1
+#define H_EAF2F30172644419A0A1B3EEF97603A1
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "batch.h"
+
+namespace metamath
+{
+	// fixed set of worker threads running parallel loops over chunks
+	// every worker owns a range of chunk indices and takes them from the front,
+	// a worker that runs out steals the back half of another worker's range,
+	// so uneven chunk costs do not leave threads idle
+	struct thread_pool
+	{
+		// the calling thread takes part in every loop, n counts it
+		explicit thread_pool(unsigned n = std::thread::hardware_concurrency())
+			:slots_(n ? n : 1)
+		{
+			for (unsigned i = 1; i < slots_.size(); ++i)
+				threads_.emplace_back([this, i] { worker(i); });
+		}
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> l(m_);
+				stop_ = true;
+			}
+			wake_.notify_all();
+			for (std::thread& t : threads_)
+				t.join();
+		}
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		unsigned size() const
+		{
+			return static_cast<unsigned>(slots_.size());
+		}
+
+		// calls f(c) for c in [0, chunks) and returns when all calls are done
+		// (a loop started from inside a chunk runs on the calling thread),
+		// if a call throws, the chunks not yet started are dropped and the
+		// first exception is rethrown once every thread has left the loop
+		template<typename F>
+		void parallel_for(std::size_t chunks, const F& f)
+		{
+			if (chunks == 0)
+				return;
+			if (current() == this || slots_.size() == 1 || chunks == 1) {
+				for (std::size_t c = 0; c < chunks; ++c)
+					f(c);
+				return;
+			}
+
+			std::lock_guard<std::mutex> run(run_);
+
+			const std::size_t w = slots_.size();
+			for (std::size_t i = 0; i < w; ++i)
+				slots_[i].r_.store(range(chunks * i / w, chunks * (i + 1) / w), std::memory_order_relaxed);
+
+			job_ = &f;
+			call_ = [](const void* p, std::size_t c) { (*static_cast<const F*>(p))(c); };
+			{
+				std::lock_guard<std::mutex> l(m_);
+				active_ = static_cast<unsigned>(w);
+				++gen_;
+			}
+			wake_.notify_all();
+
+			work(0);
+
+			std::unique_lock<std::mutex> l(m_);
+			done_.wait(l, [this] { return active_ == 0; });
+			if (error_) {
+				std::exception_ptr e = error_;
+				error_ = nullptr;
+				l.unlock();
+				std::rethrow_exception(e);
+			}
+		}
+
+		// a pool over all hardware threads
+		static thread_pool& instance()
+		{
+			static thread_pool p;
+			return p;
+		}
+
+	private:
+		// chunk range [begin, end) packed into one word
+		struct slot
+		{
+			std::atomic<std::uint64_t> r_{0};
+			char pad_[64 - sizeof(std::atomic<std::uint64_t>)]; //one cache line per worker
+		};
+
+		static std::uint64_t range(std::uint64_t b, std::uint64_t e)
+		{
+			return b << 32 | e;
+		}
+		static std::uint32_t begin(std::uint64_t r)
+		{
+			return static_cast<std::uint32_t>(r >> 32);
+		}
+		static std::uint32_t end(std::uint64_t r)
+		{
+			return static_cast<std::uint32_t>(r);
+		}
+
+		static thread_pool*& current()
+		{
+			static thread_local thread_pool* p = nullptr;
+			return p;
+		}
+
+		bool take(std::size_t i, std::size_t& c)
+		{
+			std::atomic<std::uint64_t>& s = slots_[i].r_;
+			std::uint64_t r = s.load(std::memory_order_acquire);
+			while (begin(r) < end(r)) {
+				if (s.compare_exchange_weak(r, range(begin(r) + 1, end(r)), std::memory_order_acq_rel)) {
+					c = begin(r);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool steal(std::size_t i)
+		{
+			const std::size_t w = slots_.size();
+			for (std::size_t k = 1; k < w; ++k) {
+				std::atomic<std::uint64_t>& s = slots_[(i + k) % w].r_;
+				std::uint64_t r = s.load(std::memory_order_acquire);
+				while (begin(r) < end(r)) {
+					const std::uint32_t h = (end(r) - begin(r) + 1) / 2;
+					if (s.compare_exchange_weak(r, range(begin(r), end(r) - h), std::memory_order_acq_rel)) {
+						slots_[i].r_.store(range(end(r) - h, end(r)), std::memory_order_release);
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		void work(std::size_t i)
+		{
+			current() = this;
+			std::size_t c;
+			try {
+				do {
+					while (take(i, c))
+						call_(job_, c);
+				} while (steal(i));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> l(m_);
+				if (!error_)
+					error_ = std::current_exception();
+				for (slot& s : slots_)
+					s.r_.store(range(0, 0), std::memory_order_release);
+			}
+			current() = nullptr;
+
+			std::lock_guard<std::mutex> l(m_);
+			if (--active_ == 0)
+				done_.notify_one();
+		}
+
+		void worker(std::size_t i)
+		{
+			std::uint64_t seen = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> l(m_);
+					wake_.wait(l, [&] { return stop_ || gen_ != seen; });
+					if (stop_)
+						return;
+					seen = gen_;
+				}
+				work(i);
+			}
+		}
+
+		std::vector<slot> slots_;
+		std::vector<std::thread> threads_;
+
+		const void* job_ = nullptr;
+		void (*call_)(const void*, std::size_t) = nullptr;
+
+		std::mutex run_; //one loop at a time
+		std::mutex m_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		std::uint64_t gen_ = 0;
+		unsigned active_ = 0;
+		bool stop_ = false;
+		std::exception_ptr error_; //of the first call that threw
+	};
+
+	// bytes of input and output per chunk, sized to stay in the L1/L2 cache
+	static constexpr std::size_t chunk_bytes = 16 * 1024;
+
+	// out[i] = e(in[i]) on all threads of the pool
+	// every chunk is evaluated with evaluate() (simd blocks for expressions,
+	// the interpreter for tapes) and writes only its own part of out,
+	// so the result does not depend on the scheduling
+	template<typename E, typename T, typename R>
+	void parallel_evaluate(const E& e, const T* in, R* out, std::size_t n, thread_pool& pool = thread_pool::instance())
+	{
+		const std::size_t m = chunk_bytes / (sizeof(T) + sizeof(R));
+		pool.parallel_for((n + m - 1) / m, [&](std::size_t c) {
+			const std::size_t b = c * m;
+			evaluate(e, in + b, out + b, n - b < m ? n - b : m);
+		});
+	}
+}
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef H_A8C3B2DFDFD045DD924C80F820F6B60A
+#define H_A8C3B2DFDFD045DD924C80F820F6B60A
+
+#include <cstddef>
+#include <type_traits>
+#include "simplify.h"
+#include "cost.h"
+
+namespace metamath
+{
+	namespace poly
+	{
+		// degree of E as a polynomial in the variable with the tag X, -1 if it
+		// is not one; subexpressions without variables are coefficients
+		template<typename E, typename X>
+		struct degree : std::integral_constant<int, -1> {};
+
+		constexpr int sum_degree(int a, int b)
+		{
+			return a < 0 || b < 0 ? -1 : a > b ? a : b;
+		}
+		constexpr int product_degree(int a, int b)
+		{
+			return a < 0 || b < 0 ? -1 : a + b;
+		}
+
+		template<int N, typename X>
+		struct degree<lit<N>, X> : std::integral_constant<int, 0> {};
+		template<typename T, typename X>
+		struct degree<exp<T, empty, constant>, X> : std::integral_constant<int, 0> {};
+		template<typename T, typename Tag, typename X>
+		struct degree<exp<T, Tag, variable>, X>
+			: std::integral_constant<int, var_index<Tag>::value == var_index<X>::value ? 1 : -1> {};
+		template<typename E1, typename E2, typename X>
+		struct degree<exp<E1, E2, plus>, X>
+			: std::integral_constant<int, sum_degree(degree<E1, X>::value, degree<E2, X>::value)> {};
+		template<typename E1, typename E2, typename X>
+		struct degree<exp<E1, E2, minus>, X>
+			: std::integral_constant<int, sum_degree(degree<E1, X>::value, degree<E2, X>::value)> {};
+		template<typename E1, typename E2, typename X>
+		struct degree<exp<E1, E2, mult>, X>
+			: std::integral_constant<int, product_degree(degree<E1, X>::value, degree<E2, X>::value)> {};
+		template<typename E1, typename E2, typename X>
+		struct degree<exp<E1, E2, div>, X>
+			: std::integral_constant<int, degree<E2, X>::value == 0 ? degree<E1, X>::value : -1> {};
+		template<typename E, typename X>
+		struct degree<exp<E, empty, negate>, X> : degree<E, X> {};
+		template<typename E, typename F, typename X>
+		struct degree<exp<E, F, func>, X>
+			: std::integral_constant<int, degree<E, X>::value == 0 ? 0 : -1> {};
+		template<typename E, int N, typename X>
+		struct degree<exp<E, pow_f<N>, func>, X>
+			: std::integral_constant<int, degree<E, X>::value == 0 ? 0 :
+				degree<E, X>::value < 0 || N < 0 ? -1 : degree<E, X>::value * N> {};
+		template<typename E, std::size_t D, typename C, typename X>
+		struct degree<exp<E, poly_f<D, C>, func>, X>
+			: std::integral_constant<int, degree<E, X>::value < 0 ? -1 : degree<E, X>::value * static_cast<int>(D)> {};
+
+		// the type the coefficients evaluate in, as a constant of that type
+		template<typename E, typename = void>
+		struct ctype
+		{
+			typedef int type;
+		};
+		template<typename T>
+		struct ctype<exp<T, empty, constant>>
+		{
+			typedef T type;
+		};
+		template<typename E1, typename E2, typename Op>
+		struct ctype<exp<E1, E2, Op>, std::enable_if_t<is_binary_op<Op>::value>>
+		{
+			typedef std::common_type_t<typename ctype<E1>::type, typename ctype<E2>::type> type;
+		};
+		template<typename E>
+		struct ctype<exp<E, empty, negate>> : ctype<E> {};
+		template<typename E, typename F>
+		struct ctype<exp<E, F, func>> : ctype<E> {};
+		template<typename E, std::size_t D, typename C>
+		struct ctype<exp<E, poly_f<D, C>, func>>
+		{
+			typedef std::common_type_t<C, typename ctype<E>::type> type;
+		};
+
+		// coefficient arithmetic
+		//
+		template<std::size_t D, typename R>
+		struct coeffs
+		{
+			R c_[D + 1];
+		};
+
+		// a + s * b
+		template<std::size_t A, std::size_t B, typename R>
+		constexpr coeffs<(A > B ? A : B), R> add(const coeffs<A, R>& a, const coeffs<B, R>& b, R s)
+		{
+			coeffs<(A > B ? A : B), R> r{};
+			for (std::size_t i = 0; i <= A; ++i)
+				r.c_[i] += a.c_[i];
+			for (std::size_t i = 0; i <= B; ++i)
+				r.c_[i] += s * b.c_[i];
+			return r;
+		}
+		template<std::size_t A, std::size_t B, typename R>
+		constexpr coeffs<A + B, R> mul(const coeffs<A, R>& a, const coeffs<B, R>& b)
+		{
+			coeffs<A + B, R> r{};
+			for (std::size_t i = 0; i <= A; ++i)
+				for (std::size_t j = 0; j <= B; ++j)
+					r.c_[i + j] += a.c_[i] * b.c_[j];
+			return r;
+		}
+		template<std::size_t A, typename R>
+		constexpr coeffs<A, R> scale(const coeffs<A, R>& a, R s)
+		{
+			coeffs<A, R> r{};
+			for (std::size_t i = 0; i <= A; ++i)
+				r.c_[i] = s * a.c_[i];
+			return r;
+		}
+		// p(q)
+		template<std::size_t D, std::size_t Q, typename R>
+		constexpr coeffs<D * Q, R> compose(const coeffs<D, R>& p, const coeffs<Q, R>& q)
+		{
+			coeffs<D * Q, R> r{};
+			coeffs<D * Q, R> w{}; //q^i
+			w.c_[0] = 1;
+			r.c_[0] = p.c_[0];
+			for (std::size_t i = 1; i <= D; ++i) {
+				coeffs<D * Q, R> t{};
+				for (std::size_t j = 0; j <= (i - 1) * Q; ++j)
+					for (std::size_t k = 0; k <= Q; ++k)
+						t.c_[j + k] += w.c_[j] * q.c_[k];
+				for (std::size_t j = 0; j <= i * Q; ++j) {
+					w.c_[j] = t.c_[j];
+					r.c_[j] += p.c_[i] * w.c_[j];
+				}
+			}
+			return r;
+		}
+
+		// coefficients of E, a polynomial in X
+		template<typename E, typename X, typename R, bool = degree<E, X>::value == 0>
+		struct expand
+		{
+			// no variables, E is a coefficient
+			static constexpr coeffs<0, R> apply(const E& e)
+			{
+				return {{static_cast<R>(e(R(0)))}};
+			}
+		};
+
+		template<typename T, typename Tag, typename X, typename R>
+		struct expand<exp<T, Tag, variable>, X, R, false>
+		{
+			static constexpr coeffs<1, R> apply(const exp<T, Tag, variable>&)
+			{
+				return {{R(0), R(1)}};
+			}
+		};
+		template<typename E1, typename E2, typename X, typename R>
+		struct expand<exp<E1, E2, plus>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E1, E2, plus>& e)
+			{
+				return add(expand<E1, X, R>::apply(e.e1_), expand<E2, X, R>::apply(e.e2_), R(1));
+			}
+		};
+		template<typename E1, typename E2, typename X, typename R>
+		struct expand<exp<E1, E2, minus>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E1, E2, minus>& e)
+			{
+				return add(expand<E1, X, R>::apply(e.e1_), expand<E2, X, R>::apply(e.e2_), R(-1));
+			}
+		};
+		template<typename E1, typename E2, typename X, typename R>
+		struct expand<exp<E1, E2, mult>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E1, E2, mult>& e)
+			{
+				return mul(expand<E1, X, R>::apply(e.e1_), expand<E2, X, R>::apply(e.e2_));
+			}
+		};
+		template<typename E1, typename E2, typename X, typename R>
+		struct expand<exp<E1, E2, div>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E1, E2, div>& e)
+			{
+				return scale(expand<E1, X, R>::apply(e.e1_), R(1) / static_cast<R>(e.e2_(R(0))));
+			}
+		};
+		template<typename E, typename X, typename R>
+		struct expand<exp<E, empty, negate>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E, empty, negate>& e)
+			{
+				return scale(expand<E, X, R>::apply(e.e_), R(-1));
+			}
+		};
+		template<typename E, int N, typename X, typename R>
+		struct expand<exp<E, pow_f<N>, func>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E, pow_f<N>, func>& e)
+			{
+				coeffs<N, R> p{};
+				p.c_[N] = 1;
+				return compose(p, expand<E, X, R>::apply(e.e_));
+			}
+		};
+		template<typename E, std::size_t N, typename C, typename X, typename R>
+		struct expand<exp<E, poly_f<N, C>, func>, X, R, false>
+		{
+			static constexpr auto apply(const exp<E, poly_f<N, C>, func>& e)
+			{
+				coeffs<N, R> p{};
+				for (std::size_t i = 0; i <= N; ++i)
+					p.c_[i] = static_cast<R>(e.f_.c_[i]);
+				return compose(p, expand<E, X, R>::apply(e.e_));
+			}
+		};
+
+		template<typename V>
+		struct tag_of;
+		template<typename T, typename Tag>
+		struct tag_of<exp<T, Tag, variable>>
+		{
+			typedef Tag type;
+		};
+
+		// no expression, the empty rest of a sum
+		struct none {};
+
+		template<typename Op, typename A, typename B>
+		struct join
+		{
+			static constexpr auto apply(const A& a, const B& b)
+			{
+				return combine<Op>(a, b);
+			}
+		};
+		template<typename Op, typename A>
+		struct join<Op, A, none>
+		{
+			static constexpr A apply(const A& a, none)
+			{
+				return a;
+			}
+		};
+		template<typename B>
+		struct join<plus, none, B>
+		{
+			static constexpr B apply(none, const B& b)
+			{
+				return b;
+			}
+		};
+		template<typename B>
+		struct join<minus, none, B>
+		{
+			static constexpr auto apply(none, const B& b)
+			{
+				return combine_neg(b);
+			}
+		};
+		template<>
+		struct join<plus, none, none>
+		{
+			static constexpr none apply(none, none)
+			{
+				return {};
+			}
+		};
+		template<>
+		struct join<minus, none, none>
+		{
+			static constexpr none apply(none, none)
+			{
+				return {};
+			}
+		};
+
+		template<typename E, typename V, typename = void>
+		struct pass;
+
+		// a sum split into its polynomial terms and the rest, any other
+		// expression is a single term
+		//
+		template<typename E, typename V, bool = (degree<E, typename tag_of<V>::type>::value >= 0)>
+		struct split
+		{
+			//a polynomial term
+			typedef typename tag_of<V>::type X;
+			typedef typename ctype<E>::type type;
+			static constexpr int deg = degree<E, X>::value;
+			static constexpr int terms = 1;
+			static constexpr int ops = cost<E>::adds + cost<E>::mults + cost<E>::divs + cost<E>::negs;
+
+			template<typename R>
+			static constexpr coeffs<deg, R> coefficients(const E& e)
+			{
+				return expand<E, X, R>::apply(e);
+			}
+			static constexpr none rest(const E&, const V&)
+			{
+				return {};
+			}
+		};
+		template<typename E, typename V>
+		struct split<E, V, false>
+		{
+			typedef int type;
+			static constexpr int deg = -1;
+			static constexpr int terms = 0;
+			static constexpr int ops = 0;
+
+			template<typename R>
+			static constexpr coeffs<0, R> coefficients(const E&)
+			{
+				return {};
+			}
+			static constexpr auto rest(const E& e, const V& v)
+			{
+				return pass<E, V>::apply(e, v);
+			}
+		};
+
+		template<typename E1, typename E2, typename Op, typename V>
+		struct split_sum
+		{
+			typedef split<E1, V> a;
+			typedef split<E2, V> b;
+
+			typedef std::common_type_t<typename a::type, typename b::type> type;
+			static constexpr int deg = a::deg > b::deg ? a::deg : b::deg;
+			static constexpr int terms = a::terms + b::terms;
+			static constexpr int ops = a::ops + b::ops + (a::terms && b::terms ? 1 : 0);
+
+			template<typename R>
+			static constexpr auto coefficients(const exp<E1, E2, Op>& e)
+			{
+				return add(a::template coefficients<R>(e.e1_), b::template coefficients<R>(e.e2_),
+					R(std::is_same<Op, minus>::value ? -1 : 1));
+			}
+			static constexpr auto rest(const exp<E1, E2, Op>& e, const V& v)
+			{
+				auto l = a::rest(e.e1_, v);
+				auto r = b::rest(e.e2_, v);
+				return join<Op, decltype(l), decltype(r)>::apply(l, r);
+			}
+		};
+		template<typename E1, typename E2, typename V>
+		struct split<exp<E1, E2, plus>, V, true> : split_sum<E1, E2, plus, V> {};
+		template<typename E1, typename E2, typename V>
+		struct split<exp<E1, E2, plus>, V, false> : split_sum<E1, E2, plus, V> {};
+		template<typename E1, typename E2, typename V>
+		struct split<exp<E1, E2, minus>, V, true> : split_sum<E1, E2, minus, V> {};
+		template<typename E1, typename E2, typename V>
+		struct split<exp<E1, E2, minus>, V, false> : split_sum<E1, E2, minus, V> {};
+
+		// the polynomial terms of E as one poly_f node, unless Horner's scheme
+		// takes more operations (D multiplies and D additions) than the terms
+		template<typename E, typename V, bool = (split<E, V>::deg >= 1 && 2 * split<E, V>::deg <= split<E, V>::ops)>
+		struct rewrite
+		{
+			template<typename Rebuild>
+			static constexpr auto apply(const E& e, const V& v, Rebuild)
+			{
+				typedef split<E, V> s;
+				typedef poly_f<static_cast<std::size_t>(s::deg), typename s::type> F;
+				auto c = s::template coefficients<typename F::rtype>(e);
+				F f{};
+				for (std::size_t i = 0; i <= static_cast<std::size_t>(s::deg); ++i)
+					f.c_[i] = c.c_[i];
+				auto r = s::rest(e, v);
+				return join<plus, exp<V, F, func>, decltype(r)>::apply(exp<V, F, func>{v, f}, r);
+			}
+		};
+		template<typename E, typename V>
+		struct rewrite<E, V, false>
+		{
+			template<typename Rebuild>
+			static constexpr auto apply(const E& e, const V& v, Rebuild r)
+			{
+				return r(e, v);
+			}
+		};
+
+		// leaves and unknown nodes stay as they are
+		template<typename E, typename V, typename>
+		struct pass
+		{
+			static constexpr E apply(const E& e, const V&)
+			{
+				return e;
+			}
+		};
+
+		// otherwise the operands are rewritten
+		struct rebuild
+		{
+			template<typename E1, typename E2, typename Op, typename V>
+			constexpr auto operator()(const exp<E1, E2, Op>& e, const V& v) const
+			{
+				auto a = pass<E1, V>::apply(e.e1_, v);
+				auto b = pass<E2, V>::apply(e.e2_, v);
+				return exp<decltype(a), decltype(b), Op>{a, b};
+			}
+			template<typename E, typename V>
+			constexpr auto operator()(const exp<E, empty, negate>& e, const V& v) const
+			{
+				auto a = pass<E, V>::apply(e.e_, v);
+				return exp<decltype(a), empty, negate>{a};
+			}
+			template<typename E, typename F, typename V>
+			constexpr auto operator()(const exp<E, F, func>& e, const V& v) const
+			{
+				auto a = pass<E, V>::apply(e.e_, v);
+				return exp<decltype(a), F, func>{a};
+			}
+			template<typename E, std::size_t D, typename C, typename V>
+			constexpr auto operator()(const exp<E, poly_f<D, C>, func>& e, const V& v) const
+			{
+				auto a = pass<E, V>::apply(e.e_, v);
+				return exp<decltype(a), poly_f<D, C>, func>{a, e.f_};
+			}
+		};
+
+		template<typename E1, typename E2, typename Op, typename V>
+		struct pass<exp<E1, E2, Op>, V, std::enable_if_t<is_binary_op<Op>::value>>
+		{
+			static constexpr auto apply(const exp<E1, E2, Op>& e, const V& v)
+			{
+				return rewrite<exp<E1, E2, Op>, V>::apply(e, v, rebuild{});
+			}
+		};
+		template<typename E, typename V>
+		struct pass<exp<E, empty, negate>, V>
+		{
+			static constexpr auto apply(const exp<E, empty, negate>& e, const V& v)
+			{
+				return rewrite<exp<E, empty, negate>, V>::apply(e, v, rebuild{});
+			}
+		};
+		template<typename E, typename F, typename V>
+		struct pass<exp<E, F, func>, V>
+		{
+			static constexpr auto apply(const exp<E, F, func>& e, const V& v)
+			{
+				return rewrite<exp<E, F, func>, V>::apply(e, v, rebuild{});
+			}
+		};
+	}
+
+	namespace poly
+	{
+		// the variable of index 0 in E, with its domain; void if there is none
+		template<typename E>
+		struct first_var
+		{
+			typedef void type;
+		};
+		template<typename T, typename Tag>
+		struct first_var<exp<T, Tag, variable>>
+		{
+			typedef std::conditional_t<var_index<Tag>::value == 0, exp<T, Tag, variable>, void> type;
+		};
+		template<typename E1, typename E2, typename Op>
+		struct first_var<exp<E1, E2, Op>>
+		{
+			typedef typename first_var<E1>::type t1;
+			typedef std::conditional_t<std::is_void<t1>::value, typename first_var<E2>::type, t1> type;
+		};
+
+		template<typename E, typename V = typename first_var<E>::type>
+		struct x_of
+		{
+			typedef V type;
+		};
+		template<typename E>
+		struct x_of<E, void>
+		{
+			typedef var<domain> type;
+		};
+	}
+
+	// rewrites the polynomial subexpressions in x, also the polynomial terms
+	// of a sum with other terms, into poly_f nodes evaluated by Horner's
+	// scheme (Estrin's in simd blocks), where that takes fewer operations:
+	// 3 * x * x + 2 * x + 1 into (1 + 2 * x + 3 * (x)^2);
+	// x is the variable of index 0 as E has it, var<double> t included
+	template<typename E>
+	constexpr auto polynomial(const E& e)
+	{
+		typedef typename poly::x_of<E>::type X;
+		return poly::pass<E, X>::apply(e, X{});
+	}
+
+	// polynomials in the variable v, other variables are not coefficients
+	template<typename E, typename T, typename Tag>
+	constexpr auto polynomial(const E& e, const exp<T, Tag, variable>& v)
+	{
+		return poly::pass<E, exp<T, Tag, variable>>::apply(e, v);
+	}
+}
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef H_8518986390BC4FC982C4829E2B7D6D45
+#define H_8518986390BC4FC982C4829E2B7D6D45
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "batch.h"
+
+namespace metamath
+{
+	namespace prof
+	{
+		// operation kinds, Pow<N> is counted as its multiplications;
+		// sin .. ln are timed calls, abs is a sign bit as in cost.h and only counted
+		enum class kind
+		{
+			add, sub, mul, div, neg, sin, cos, sqrt, exp, ln, abs, count
+		};
+
+		static constexpr std::size_t kinds = static_cast<std::size_t>(kind::count);
+
+		inline const char* name(kind k)
+		{
+			static const char* const names[kinds] = {
+				"add", "sub", "mul", "div", "neg", "sin", "cos", "sqrt", "exp", "ln", "abs"
+			};
+			return names[static_cast<std::size_t>(k)];
+		}
+
+		typedef std::chrono::steady_clock clock_type;
+
+		// the cost of one clock_type::now() pair, taken off each timed call
+		inline double timer_ns()
+		{
+			static const double ns = [] {
+				double best = 0;
+				for (int i = 0; i < 64; ++i) {
+					const auto t0 = clock_type::now();
+					const auto t1 = clock_type::now();
+					const double d = std::chrono::duration<double, std::nano>(t1 - t0).count();
+					best = i == 0 || d < best ? d : best;
+				}
+				return best;
+			}();
+			return ns;
+		}
+
+		// visits per operation kind and the time spent in the function calls,
+		// simd lanes count one visit each
+		struct profile
+		{
+			std::uint64_t visits_[kinds] = {};
+			double ns_[kinds] = {};
+
+			std::uint64_t visits(kind k) const
+			{
+				return visits_[static_cast<std::size_t>(k)];
+			}
+			double ns(kind k) const
+			{
+				return ns_[static_cast<std::size_t>(k)];
+			}
+			std::uint64_t total() const
+			{
+				std::uint64_t n = 0;
+				for (std::size_t i = 0; i < kinds; ++i)
+					n += visits_[i];
+				return n;
+			}
+
+			void reset()
+			{
+				*this = profile{};
+			}
+
+			template<typename Os>
+			Os& print(Os& os) const
+			{
+				for (std::size_t i = 0; i < kinds; ++i) {
+					if (!visits_[i])
+						continue;
+					os << name(static_cast<kind>(i)) << ": " << visits_[i];
+					if (ns_[i] > 0)
+						os << ", " << ns_[i] / visits_[i] << " ns/call";
+					os << "\n";
+				}
+				return os;
+			}
+		};
+
+		// the profile the counted operations of this thread go to
+		inline profile*& current()
+		{
+			static thread_local profile* p = nullptr;
+			return p;
+		}
+
+		inline void count(kind k)
+		{
+			if (profile* p = current())
+				++p->visits_[static_cast<std::size_t>(k)];
+		}
+
+		// times f(v) as a call of the kind k
+		template<typename F, typename T>
+		T timed(kind k, F f, T v)
+		{
+			profile* p = current();
+			if (!p)
+				return f(v);
+			const auto t0 = clock_type::now();
+			const T r = f(v);
+			const double d = std::chrono::duration<double, std::nano>(clock_type::now() - t0).count() - timer_ns();
+			const std::size_t i = static_cast<std::size_t>(k);
+			++p->visits_[i];
+			p->ns_[i] += d > 0 ? d : 0;
+			return r;
+		}
+
+		template<typename U>
+		using if_scalar = std::enable_if_t<std::is_arithmetic<U>::value>;
+
+		// a number whose operations are counted, the func.h functors
+		// find its sin, cos, exp, log, sqrt and abs through ADL
+		template<typename T>
+		struct num
+		{
+			typedef T type;
+
+			T v_;
+
+			num() = default;
+			template<typename U, typename = if_scalar<U>>
+			constexpr num(U v)
+				:v_{static_cast<T>(v)}
+			{
+			}
+		};
+
+#define METAMATH_NUM_OP(OP, KIND) \
+		template<typename T> \
+		num<T> operator OP(const num<T>& a, const num<T>& b) \
+		{ \
+			count(kind::KIND); \
+			return {a.v_ OP b.v_}; \
+		} \
+		template<typename T, typename U, typename = if_scalar<U>> \
+		num<T> operator OP(const num<T>& a, U b) \
+		{ \
+			count(kind::KIND); \
+			return {a.v_ OP static_cast<T>(b)}; \
+		} \
+		template<typename U, typename T, typename = if_scalar<U>> \
+		num<T> operator OP(U a, const num<T>& b) \
+		{ \
+			count(kind::KIND); \
+			return {static_cast<T>(a) OP b.v_}; \
+		}
+
+		METAMATH_NUM_OP(+, add)
+		METAMATH_NUM_OP(-, sub)
+		METAMATH_NUM_OP(*, mul)
+		METAMATH_NUM_OP(/, div)
+
+#undef METAMATH_NUM_OP
+
+		template<typename T>
+		num<T> operator-(const num<T>& a)
+		{
+			count(kind::neg);
+			return {-a.v_};
+		}
+
+#define METAMATH_NUM_FUNC(NAME, KIND) \
+		template<typename T> \
+		num<T> NAME(const num<T>& a) \
+		{ \
+			return {timed(kind::KIND, [](T v) { return std::NAME(v); }, a.v_)}; \
+		}
+
+		METAMATH_NUM_FUNC(sin, sin)
+		METAMATH_NUM_FUNC(cos, cos)
+		METAMATH_NUM_FUNC(sqrt, sqrt)
+		METAMATH_NUM_FUNC(exp, exp)
+		METAMATH_NUM_FUNC(log, ln)
+
+#undef METAMATH_NUM_FUNC
+
+		template<typename T>
+		num<T> abs(const num<T>& a)
+		{
+			count(kind::abs);
+			return {std::abs(a.v_)};
+		}
+
+		// moves arguments into the counted domain and results back out,
+		// scalars and simd packs are supported, other domains pass as they are
+		struct convert
+		{
+			template<typename V, typename = std::enable_if_t<!std::is_arithmetic<V>::value>>
+			static V in(const V& v)
+			{
+				return v;
+			}
+			template<typename T, typename = if_scalar<T>>
+			static num<T> in(T v)
+			{
+				return {v};
+			}
+			template<typename T, std::size_t N>
+			static simd::pack<num<T>, N> in(const simd::pack<T, N>& v)
+			{
+				simd::pack<num<T>, N> r;
+				for (std::size_t i = 0; i < N; ++i)
+					r.v_[i] = {v.v_[i]};
+				return r;
+			}
+
+			template<typename V>
+			static V out(const V& v)
+			{
+				return v;
+			}
+			template<typename T>
+			static T out(const num<T>& v)
+			{
+				return v.v_;
+			}
+			template<typename T, std::size_t N>
+			static simd::pack<T, N> out(const simd::pack<num<T>, N>& v)
+			{
+				simd::pack<T, N> r;
+				for (std::size_t i = 0; i < N; ++i)
+					r.v_[i] = v.v_[i].v_;
+				return r;
+			}
+		};
+
+		// makes p the current profile for its lifetime, restores the previous
+		// one also when the evaluation throws
+		struct scope
+		{
+			profile* saved_;
+
+			explicit scope(profile* p)
+				:saved_{current()}
+			{
+				current() = p;
+			}
+			~scope()
+			{
+				current() = saved_;
+			}
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+		};
+
+		// an expression whose evaluations are counted into p_
+		template<typename E>
+		struct expr
+		{
+			E e_;
+			profile* p_;
+
+			template<typename V>
+			auto operator()(const V& v) const
+			{
+				scope s(p_);
+				return convert::out(e_(convert::in(v)));
+			}
+
+			template<typename Os>
+			Os& print(Os& os) const
+			{
+				os << e_;
+				return os;
+			}
+		};
+	}
+
+	// opt-in instrumented evaluation: profiled(f, p)(x), evaluate(profiled(f, p), ...)
+	// the plain f is not affected
+	template<typename E>
+	prof::expr<E> profiled(const E& e, prof::profile& p)
+	{
+		return {e, &p};
+	}
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef H_96B07E08338A4260BDC30D272586BA02
+#define H_96B07E08338A4260BDC30D272586BA02
+
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "batch.h"
+
+namespace metamath
+{
+	template<typename T>
+	struct quad_options
+	{
+		T abs_tol_ = 0;
+		T rel_tol_ = 100 * std::numeric_limits<T>::epsilon(); //relative to the integral of |f|
+		int max_depth_ = 24; //subdivisions of a panel, accepted as is below that
+		std::size_t max_panels_ = 2000; //panels of an integral, no more splits past that
+	};
+
+	// 7-point Gauss / 15-point Kronrod rule on [-1, 1]
+	// nodes x_[0..6] are used as +-x, x_[7] = 0, the Gauss nodes are the odd ones
+	struct gauss_kronrod15
+	{
+		static constexpr std::size_t size = 15;
+
+		static const double* x()
+		{
+			static const double v[8] = {
+				0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+				0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+				0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+				0.207784955007898467600689403773245, 0.0};
+			return v;
+		}
+		static const double* wk()
+		{
+			static const double v[8] = {
+				0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+				0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+				0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+				0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+			return v;
+		}
+		static const double* wg() //of x[1], x[3], x[5], x[7]
+		{
+			static const double v[4] = {
+				0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+				0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+			return v;
+		}
+	};
+
+	// adaptive Gauss-Kronrod integration of n integrals: out[k] = integral of f over [a[k], b[k]]
+	// all panels that are still open, of all integrals, are refined together:
+	// the nodes of a round go through one evaluate() call (simd blocks, or the
+	// interpreter for tapes), then every panel is accepted or split in two
+	// a panel with a NaN or infinite estimate is accepted at once, its
+	// integral gets that value and an infinite error
+	template<typename E, typename T>
+	void integrate(const E& e, const T* a, const T* b, T* out, std::size_t n,
+		const quad_options<T>& o = {}, T* err = nullptr)
+	{
+		typedef gauss_kronrod15 rule;
+		using std::abs;
+
+		struct panel
+		{
+			std::size_t k_; //integral
+			T a_;
+			T b_;
+			int depth_;
+		};
+
+		std::vector<panel> open;
+		std::vector<panel> next;
+		std::vector<T> scale(n, T(0)); //integral of |f|, from the first round
+		std::vector<std::size_t> panels(n, 1); //made so far
+		std::vector<T> nodes;
+		std::vector<T> values;
+
+		open.reserve(n);
+		for (std::size_t k = 0; k < n; ++k) {
+			out[k] = 0;
+			if (err)
+				err[k] = 0;
+			if (a[k] != b[k])
+				open.push_back({k, a[k], b[k], 0});
+		}
+
+		const double* x = rule::x();
+		const double* wk = rule::wk();
+		const double* wg = rule::wg();
+
+		while (!open.empty()) {
+			nodes.resize(open.size() * rule::size);
+			values.resize(nodes.size());
+			for (std::size_t p = 0; p < open.size(); ++p) {
+				const T c = (open[p].a_ + open[p].b_) / 2;
+				const T h = (open[p].b_ - open[p].a_) / 2;
+				T* q = &nodes[p * rule::size];
+				for (std::size_t j = 0; j < 7; ++j) {
+					q[2 * j] = c - h * static_cast<T>(x[j]);
+					q[2 * j + 1] = c + h * static_cast<T>(x[j]);
+				}
+				q[14] = c;
+			}
+
+			evaluate(e, nodes.data(), values.data(), nodes.size());
+
+			next.clear();
+			for (std::size_t p = 0; p < open.size(); ++p) {
+				const panel& pn = open[p];
+				const T h = (pn.b_ - pn.a_) / 2;
+				const T* f = &values[p * rule::size];
+
+				T kr = static_cast<T>(wk[7]) * f[14];
+				T ga = static_cast<T>(wg[3]) * f[14];
+				T ab = static_cast<T>(wk[7]) * abs(f[14]);
+				for (std::size_t j = 0; j < 7; ++j) {
+					const T s = f[2 * j] + f[2 * j + 1];
+					kr += static_cast<T>(wk[j]) * s;
+					ab += static_cast<T>(wk[j]) * (abs(f[2 * j]) + abs(f[2 * j + 1]));
+					if (j % 2)
+						ga += static_cast<T>(wg[j / 2]) * s;
+				}
+				kr *= h;
+				ga *= h;
+				const T e_k = abs(kr - ga);
+
+				if (pn.depth_ == 0)
+					scale[pn.k_] = abs(ab * h);
+
+					// the tolerance of the integral, shared by panel width
+				const T tol = (o.abs_tol_ > o.rel_tol_ * scale[pn.k_] ? o.abs_tol_ : o.rel_tol_ * scale[pn.k_])
+					* abs((pn.b_ - pn.a_) / (b[pn.k_] - a[pn.k_]));
+				const T m = pn.a_ + h;
+				if (!std::isfinite(kr) || !std::isfinite(e_k)) {
+					out[pn.k_] += kr;
+					if (err)
+						err[pn.k_] = std::numeric_limits<T>::infinity();
+				}
+				else if (e_k <= tol || pn.depth_ >= o.max_depth_ || panels[pn.k_] + 2 > o.max_panels_
+					|| m == pn.a_ || m == pn.b_) {
+					out[pn.k_] += kr;
+					if (err)
+						err[pn.k_] += e_k;
+				}
+				else {
+					next.push_back({pn.k_, pn.a_, m, pn.depth_ + 1});
+					next.push_back({pn.k_, m, pn.b_, pn.depth_ + 1});
+					panels[pn.k_] += 2;
+				}
+			}
+			open.swap(next);
+		}
+	}
+
+	// integral of f over [a, b]
+	template<typename E, typename T>
+	T integrate(const E& e, T a, T b, const quad_options<T>& o = {}, T* err = nullptr)
+	{
+		T r;
+		integrate(e, &a, &b, &r, 1, o, err);
+		return r;
+	}
+}
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef H_65CCDAA2566D421291A82985E4D33F18
+#define H_65CCDAA2566D421291A82985E4D33F18
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tape.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define METAMATH_MMAP 1
+#endif
+
+namespace metamath
+{
+	// binary image of tapes, written once and evaluated in place
+	//
+	//   header    16 bytes: magic "MMTI", version, sizeof(T), number of tapes
+	//   entries   32 bytes per tape: offset of its data, instructions,
+	//             constants, registers, variables, result register
+	//   data      per tape: the instructions (vm::instr, 16 bytes each), then
+	//             the constants (T), padded to 16 bytes
+	//
+	// numbers are stored in the byte order of the writer, a reader of the
+	// other order sees a wrong magic and rejects the image
+	namespace img
+	{
+		static constexpr std::uint32_t magic = 0x49544d4du; //"MMTI" little-endian
+		static constexpr std::uint16_t version = 1;
+		static constexpr std::size_t align = 16;
+
+		struct header
+		{
+			std::uint32_t magic_;
+			std::uint16_t version_;
+			std::uint16_t value_size_;
+			std::uint32_t count_;
+			std::uint32_t reserved_;
+		};
+		struct entry
+		{
+			std::uint64_t offset_; //from the start of the image
+			std::uint32_t size_;
+			std::uint32_t consts_;
+			std::uint32_t regs_;
+			std::uint32_t vars_;
+			std::uint32_t out_;
+			std::uint32_t reserved_;
+		};
+
+		static_assert(sizeof(header) == 16, "image header layout");
+		static_assert(sizeof(entry) == 32, "image entry layout");
+		static_assert(sizeof(vm::instr) == 16, "image instruction layout");
+
+		inline std::size_t padded(std::size_t n)
+		{
+			return (n + align - 1) / align * align;
+		}
+
+		// every operand of the program in range, so a damaged image
+		// cannot make the interpreter read outside of it
+		inline bool check(const entry& e, const vm::instr* code)
+		{
+			if (!e.size_ || e.out_ >= e.regs_)
+				return false;
+			for (std::size_t i = 0; i < e.size_; ++i) {
+				const vm::instr& c = code[i];
+				if (c.op_ > vm::op::pow || c.dst_ >= e.regs_)
+					return false;
+				if (c.op_ == vm::op::cnst ? c.a_ >= e.consts_
+					: c.op_ == vm::op::var ? c.a_ >= e.vars_
+					: c.a_ >= e.regs_ || (!vm::unary(c.op_) && c.b_ >= e.regs_))
+					return false;
+			}
+			return true;
+		}
+	}
+
+	// builds an image, add() returns the index of the tape in it
+	template<typename T>
+	struct image_writer
+	{
+		std::vector<img::entry> entries_;
+		std::string data_; //offsets of entries_ are relative to it
+
+		std::uint32_t add(const tape<T>& t)
+		{
+			img::entry e = {data_.size(), static_cast<std::uint32_t>(t.code_.size()),
+				static_cast<std::uint32_t>(t.consts_.size()), t.regs_, t.vars_, t.out_, 0};
+			data_.append(reinterpret_cast<const char*>(t.code_.data()), t.code_.size() * sizeof(vm::instr));
+			data_.append(reinterpret_cast<const char*>(t.consts_.data()), t.consts_.size() * sizeof(T));
+			data_.resize(img::padded(data_.size()));
+			entries_.push_back(e);
+			return static_cast<std::uint32_t>(entries_.size() - 1);
+		}
+		template<typename E>
+		std::uint32_t add(const E& e)
+		{
+			return add(compile<T>(e));
+		}
+
+		std::size_t size() const
+		{
+			return entries_.size();
+		}
+
+		// the image as bytes
+		std::string str() const
+		{
+			const img::header h = {img::magic, img::version, sizeof(T),
+				static_cast<std::uint32_t>(entries_.size()), 0};
+			const std::size_t base = img::padded(sizeof(h) + entries_.size() * sizeof(img::entry));
+
+			std::string r(base, '\0');
+			std::memcpy(&r[0], &h, sizeof(h));
+			for (std::size_t i = 0; i < entries_.size(); ++i) {
+				img::entry e = entries_[i];
+				e.offset_ += base;
+				std::memcpy(&r[sizeof(h) + i * sizeof(e)], &e, sizeof(e));
+			}
+			r += data_;
+			return r;
+		}
+
+		// false if the file cannot be written
+		bool write(const std::string& path) const
+		{
+			const std::string s = str();
+			FILE* f = std::fopen(path.c_str(), "wb");
+			if (!f)
+				return false;
+			const bool ok = std::fwrite(s.data(), 1, s.size(), f) == s.size();
+			return std::fclose(f) == 0 && ok;
+		}
+	};
+
+	// the tapes of an image in memory, nothing is copied or allocated:
+	// image[i] points into the bytes, which must outlive it
+	// the header and the entries are checked on construction, and every
+	// program unless check is false (a trusted image, then only the pages
+	// of the programs evaluated are read); an image of another version,
+	// value type or byte order, or a damaged one, is empty
+	template<typename T>
+	struct image
+	{
+		const unsigned char* p_ = nullptr;
+		std::size_t count_ = 0;
+
+		image() = default;
+		image(const void* data, std::size_t size, bool check = true)
+		{
+			const unsigned char* p = static_cast<const unsigned char*>(data);
+			const std::size_t a = alignof(T) > alignof(img::entry) ? alignof(T) : alignof(img::entry);
+
+			img::header h;
+			if (!p || size < sizeof(h) || reinterpret_cast<std::uintptr_t>(p) % a)
+				return;
+			std::memcpy(&h, p, sizeof(h));
+			if (h.magic_ != img::magic || h.version_ != img::version || h.value_size_ != sizeof(T)
+				|| h.count_ > (size - sizeof(h)) / sizeof(img::entry))
+				return;
+
+			const img::entry* es = reinterpret_cast<const img::entry*>(p + sizeof(h));
+			for (std::size_t i = 0; i < h.count_; ++i) {
+				const img::entry& e = es[i];
+				if (e.offset_ % img::align || e.offset_ > size)
+					return;
+				const std::uint64_t bytes = std::uint64_t(e.size_) * sizeof(vm::instr) + std::uint64_t(e.consts_) * sizeof(T);
+				if (bytes > size - e.offset_ || (check && !img::check(e, reinterpret_cast<const vm::instr*>(p + e.offset_))))
+					return;
+			}
+			p_ = p;
+			count_ = h.count_;
+		}
+
+		explicit operator bool() const
+		{
+			return p_ != nullptr;
+		}
+		std::size_t size() const
+		{
+			return count_;
+		}
+
+		tape_view<T> operator[](std::size_t i) const
+		{
+			const img::entry& e = reinterpret_cast<const img::entry*>(p_ + sizeof(img::header))[i];
+			const vm::instr* code = reinterpret_cast<const vm::instr*>(p_ + e.offset_);
+			return {code, e.size_, reinterpret_cast<const T*>(code + e.size_), e.regs_, e.vars_, e.out_};
+		}
+	};
+
+	// a read-only file in memory: mapped where mmap is available, read otherwise
+	struct mapped_file
+	{
+		const void* data_ = nullptr;
+		std::size_t size_ = 0;
+		std::vector<char> buf_; //the read file, without mmap
+
+		mapped_file() = default;
+		explicit mapped_file(const std::string& path)
+		{
+#ifdef METAMATH_MMAP
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return;
+			struct stat st;
+			if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+				void* p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					data_ = p;
+					size_ = static_cast<std::size_t>(st.st_size);
+				}
+			}
+			::close(fd);
+#else
+			FILE* f = std::fopen(path.c_str(), "rb");
+			if (!f)
+				return;
+			char chunk[1 << 16];
+			std::size_t n;
+			while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+				buf_.insert(buf_.end(), chunk, chunk + n);
+			const bool ok = !std::ferror(f);
+			std::fclose(f);
+			if (ok && !buf_.empty()) {
+				data_ = buf_.data();
+				size_ = buf_.size();
+			}
+#endif
+		}
+		mapped_file(mapped_file&& m)
+			:data_{m.data_}, size_{m.size_}, buf_{std::move(m.buf_)}
+		{
+			m.data_ = nullptr;
+			m.size_ = 0;
+		}
+		mapped_file& operator=(mapped_file&& m)
+		{
+			std::swap(data_, m.data_);
+			std::swap(size_, m.size_);
+			std::swap(buf_, m.buf_);
+			return *this;
+		}
+		~mapped_file()
+		{
+#ifdef METAMATH_MMAP
+			if (data_)
+				::munmap(const_cast<void*>(data_), size_);
+#endif
+		}
+
+		explicit operator bool() const
+		{
+			return data_ != nullptr;
+		}
+		const void* data() const
+		{
+			return data_;
+		}
+		std::size_t size() const
+		{
+			return size_;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef H_F238CC77403841D4961F706B6E709341
+#define H_F238CC77403841D4961F706B6E709341
+
+#include <type_traits>
+#include "func.h"
+
+namespace metamath
+{
+	// compile-time checks on literal nodes
+	//
+	template<typename E>
+	struct is_lit : std::false_type {};
+	template<int N>
+	struct is_lit<lit<N>> : std::true_type {};
+
+	template<typename E, int N>
+	struct is_lit_n : std::false_type {};
+	template<int N>
+	struct is_lit_n<lit<N>, N> : std::true_type {};
+
+	template<typename Op>
+	struct is_binary_op : std::false_type {};
+	template<>
+	struct is_binary_op<plus> : std::true_type {};
+	template<>
+	struct is_binary_op<minus> : std::true_type {};
+	template<>
+	struct is_binary_op<mult> : std::true_type {};
+	template<>
+	struct is_binary_op<div> : std::true_type {};
+
+	// rewrite rules, selected by the operand types only
+	//
+	namespace rules
+	{
+		struct keep;  //no rewrite
+		struct left;  //the left operand
+		struct right; //the right operand
+		struct nil;   //literal 0
+		struct fold;  //both operands are literals
+		struct neg;   //negated right operand
+		struct neg_left; //negated left operand
+	}
+
+	template<typename Op, typename A, typename B>
+	struct rule
+	{
+		typedef rules::keep type;
+	};
+
+	template<typename A, typename B>
+	struct rule<plus, A, B>
+	{
+		typedef std::conditional_t<is_lit_n<A, 0>::value, rules::right,
+			std::conditional_t<is_lit_n<B, 0>::value, rules::left,
+			std::conditional_t<is_lit<A>::value && is_lit<B>::value, rules::fold,
+			rules::keep>>> type;
+	};
+
+	template<typename A, typename B>
+	struct rule<minus, A, B>
+	{
+		typedef std::conditional_t<is_lit_n<B, 0>::value, rules::left,
+			std::conditional_t<is_lit_n<A, 0>::value, rules::neg,
+			std::conditional_t<is_lit<A>::value && is_lit<B>::value, rules::fold,
+			rules::keep>>> type;
+	};
+
+	template<typename A, typename B>
+	struct rule<mult, A, B>
+	{
+		typedef std::conditional_t<is_lit_n<A, 0>::value || is_lit_n<B, 0>::value, rules::nil,
+			std::conditional_t<is_lit_n<A, 1>::value, rules::right,
+			std::conditional_t<is_lit_n<B, 1>::value, rules::left,
+			std::conditional_t<is_lit<A>::value && is_lit<B>::value, rules::fold,
+			std::conditional_t<is_lit_n<A, -1>::value, rules::neg,
+			std::conditional_t<is_lit_n<B, -1>::value, rules::neg_left,
+			rules::keep>>>>>> type;
+	};
+
+	template<typename A, typename B>
+	struct rule<div, A, B>
+	{
+		typedef std::conditional_t<is_lit_n<A, 0>::value, rules::nil,
+			std::conditional_t<is_lit_n<B, 1>::value, rules::left,
+			rules::keep>> type;
+	};
+
+	template<typename E>
+	struct neg_rule
+	{
+		typedef rules::keep type;
+	};
+	template<typename E>
+	struct neg_rule<exp<E, empty, negate>>
+	{
+		typedef rules::right type;
+	};
+	template<int N>
+	struct neg_rule<lit<N>>
+	{
+		typedef rules::fold type;
+	};
+
+	// rule implementations
+	//
+	template<typename Op, typename Rule>
+	struct rewrite;
+
+	template<typename Op>
+	struct rewrite<Op, rules::keep>
+	{
+		template<typename A, typename B>
+		static constexpr exp<A, B, Op> apply(const A& a, const B& b)
+		{
+			return {a, b};
+		}
+	};
+	template<typename Op>
+	struct rewrite<Op, rules::left>
+	{
+		template<typename A, typename B>
+		static constexpr A apply(const A& a, const B&)
+		{
+			return a;
+		}
+	};
+	template<typename Op>
+	struct rewrite<Op, rules::right>
+	{
+		template<typename A, typename B>
+		static constexpr B apply(const A&, const B& b)
+		{
+			return b;
+		}
+	};
+	template<typename Op>
+	struct rewrite<Op, rules::nil>
+	{
+		template<typename A, typename B>
+		static constexpr lit<0> apply(const A&, const B&)
+		{
+			return {};
+		}
+	};
+	template<>
+	struct rewrite<plus, rules::fold>
+	{
+		template<typename A, typename B>
+		static constexpr lit<A::value + B::value> apply(const A&, const B&)
+		{
+			return {};
+		}
+	};
+	template<>
+	struct rewrite<minus, rules::fold>
+	{
+		template<typename A, typename B>
+		static constexpr lit<A::value - B::value> apply(const A&, const B&)
+		{
+			return {};
+		}
+	};
+	template<>
+	struct rewrite<mult, rules::fold>
+	{
+		template<typename A, typename B>
+		static constexpr lit<A::value * B::value> apply(const A&, const B&)
+		{
+			return {};
+		}
+	};
+
+	template<>
+	struct rewrite<negate, rules::keep>
+	{
+		template<typename E>
+		static constexpr exp<E, empty, negate> apply(const E& e)
+		{
+			return {e};
+		}
+	};
+	template<>
+	struct rewrite<negate, rules::right>
+	{
+			// -(-e)
+		template<typename E>
+		static constexpr E apply(const exp<E, empty, negate>& e)
+		{
+			return e.e_;
+		}
+	};
+	template<>
+	struct rewrite<negate, rules::fold>
+	{
+		template<int N>
+		static constexpr lit<-N> apply(const lit<N>&)
+		{
+			return {};
+		}
+	};
+
+	template<typename E>
+	constexpr auto combine_neg(const E& e)
+	{
+		return rewrite<negate, typename neg_rule<E>::type>::apply(e);
+	}
+
+	template<typename Op>
+	struct rewrite<Op, rules::neg>
+	{
+			// 0 - b, -1 * b
+		template<typename A, typename B>
+		static constexpr auto apply(const A&, const B& b)
+		{
+			return combine_neg(b);
+		}
+	};
+	template<typename Op>
+	struct rewrite<Op, rules::neg_left>
+	{
+			// a * -1
+		template<typename A, typename B>
+		static constexpr auto apply(const A& a, const B&)
+		{
+			return combine_neg(a);
+		}
+	};
+
+	template<typename Op, typename A, typename B>
+	constexpr auto combine(const A& a, const B& b)
+	{
+		return rewrite<Op, typename rule<Op, A, B>::type>::apply(a, b);
+	}
+
+	// the simplification pass, bottom-up over the expression tree
+	//
+	template<typename E, typename = void>
+	struct smp
+	{
+		// leaves and unknown nodes stay as they are
+		static constexpr E apply(const E& e)
+		{
+			return e;
+		}
+	};
+
+	template<typename E1, typename E2, typename Op>
+	struct smp<exp<E1, E2, Op>, std::enable_if_t<is_binary_op<Op>::value>>
+	{
+		static constexpr auto apply(const exp<E1, E2, Op>& e)
+		{
+			return combine<Op>(smp<E1>::apply(e.e1_), smp<E2>::apply(e.e2_));
+		}
+	};
+
+	template<typename E>
+	struct smp<exp<E, empty, negate>>
+	{
+		static constexpr auto apply(const exp<E, empty, negate>& e)
+		{
+			return combine_neg(smp<E>::apply(e.e_));
+		}
+	};
+
+	template<typename E, typename F>
+	struct smp<exp<E, F, func>>
+	{
+		static constexpr auto apply(const exp<E, F, func>& e)
+		{
+			auto s = smp<E>::apply(e.e_);
+			return exp<decltype(s), F, func>{s};
+		}
+	};
+
+	template<typename E, std::size_t D, typename C>
+	struct smp<exp<E, poly_f<D, C>, func>>
+	{
+		static constexpr auto apply(const exp<E, poly_f<D, C>, func>& e)
+		{
+			auto s = smp<E>::apply(e.e_);
+			return exp<decltype(s), poly_f<D, C>, func>{s, e.f_};
+		}
+	};
+
+	// e^1 is e, e^0 is 1
+	template<typename E>
+	struct smp<exp<E, pow_f<1>, func>>
+	{
+		static constexpr auto apply(const exp<E, pow_f<1>, func>& e)
+		{
+			return smp<E>::apply(e.e_);
+		}
+	};
+	template<typename E>
+	struct smp<exp<E, pow_f<0>, func>>
+	{
+		static constexpr lit<1> apply(const exp<E, pow_f<0>, func>&)
+		{
+			return {};
+		}
+	};
+
+	// folds 0*e, 1*e, e*1, e+0, 0+e, e-0, 0-e, 0/e, e/1, -(-e), e^1, e^0,
+	// lowers -1*e and e*-1 to -e and folds literal arithmetic at the type level
+	template<typename E>
+		constexpr auto simplify(const E& e)
+		{
+			return smp<E>::apply(e);
+		}
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef H_63857F87FB564E05AEF9A8BA3B41A691
+#define H_63857F87FB564E05AEF9A8BA3B41A691
+
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include "batch.h"
+#include "taylor.h"
+
+namespace metamath
+{
+	template<typename T>
+	struct solve_options
+	{
+		int max_iter_ = 50;
+		T xtol_ = 16 * std::numeric_limits<T>::epsilon(); //step, relative to 1 + |x|
+		T ftol_ = 0;             //residual that counts as a root
+		const T* rhs_ = nullptr; //solve f(x) = rhs[i] instead of f(x) = 0
+		const T* lo_ = nullptr;  //optional brackets [lo[i], hi[i]],
+		const T* hi_ = nullptr;  //steps leaving a bracket become bisections
+	};
+
+	namespace solver
+	{
+		// iterates on g = f^(D) - rhs for blocks of simd::lanes<T> points at once,
+		// f, f` (and f`` for Halley) come from one Taylor-mode walk per step,
+		// lanes that converged are kept fixed while the others go on
+		// D == 1 finds minima: the step divides by |f``| so it always goes downhill
+		template<std::size_t D, bool Halley, typename E, typename T>
+		std::size_t run(const E& e, T* x, std::size_t n, const solve_options<T>& o, bool* ok)
+		{
+			constexpr std::size_t L = simd::lanes<T>::value;
+			constexpr std::size_t K = D + (Halley ? 2 : 1);
+			typedef simd::pack<T, L> pack_t;
+			typedef ad::taylor<pack_t, K> series;
+
+			using std::abs;
+			using std::isfinite;
+
+			auto eval = [&e](const pack_t& v) {
+				return series::lift(e(series::variable(v)));
+			};
+
+			std::size_t found = 0;
+			for (std::size_t i = 0; i < n; i += L) {
+				const std::size_t m = n - i < L ? n - i : L;
+
+				pack_t xp, rhs(0), lo, hi;
+				bool done[L];
+				bool conv[L];
+				bool br[L];   //bracket in use
+				bool neg[L];  //g(lo) < 0
+				for (std::size_t l = 0; l < L; ++l) {
+					const std::size_t j = i + (l < m ? l : m - 1); //pad the last block
+					xp.v_[l] = x[j];
+					if (o.rhs_ && D == 0)
+						rhs.v_[l] = o.rhs_[j];
+					done[l] = l >= m;
+					conv[l] = false;
+					br[l] = false;
+					neg[l] = false;
+				}
+
+				if (o.lo_ && o.hi_) {
+					for (std::size_t l = 0; l < L; ++l) {
+						const std::size_t j = i + (l < m ? l : m - 1);
+						lo.v_[l] = o.lo_[j];
+						hi.v_[l] = o.hi_[j];
+					}
+					pack_t glo = eval(lo).derivative(D) - rhs;
+					pack_t ghi = eval(hi).derivative(D) - rhs;
+					for (std::size_t l = 0; l < m; ++l) {
+						if (glo.v_[l] == 0 || ghi.v_[l] == 0) {
+							xp.v_[l] = glo.v_[l] == 0 ? lo.v_[l] : hi.v_[l];
+							done[l] = conv[l] = true;
+						}
+						else if ((glo.v_[l] < 0) != (ghi.v_[l] < 0)) {
+							br[l] = true;
+							neg[l] = glo.v_[l] < 0;
+							if (!(xp.v_[l] > lo.v_[l] && xp.v_[l] < hi.v_[l]))
+								xp.v_[l] = (lo.v_[l] + hi.v_[l]) / 2;
+						}
+					}
+				}
+
+				for (int it = 0; it < o.max_iter_; ++it) {
+					series s = eval(xp);
+					const pack_t g = s.derivative(D) - rhs;
+					const pack_t g1 = s.derivative(D + 1);
+					const pack_t g2 = s.derivative(Halley ? D + 2 : D);
+
+					bool all = true;
+					for (std::size_t l = 0; l < m; ++l) {
+						if (done[l])
+							continue;
+
+						const T xv = xp.v_[l];
+						const T gv = g.v_[l];
+						const T d1 = D == 1 ? abs(g1.v_[l]) : g1.v_[l];
+						if (abs(gv) <= o.ftol_) {
+							done[l] = conv[l] = true;
+							continue;
+						}
+						if (br[l]) {
+							if ((gv < 0) == neg[l])
+								lo.v_[l] = xv;
+							else
+								hi.v_[l] = xv;
+						}
+
+						T xn = Halley ? xv - 2 * gv * d1 / (2 * d1 * d1 - gv * g2.v_[l]) : xv - gv / d1;
+						if (br[l] && !(xn > lo.v_[l] && xn < hi.v_[l]))
+							xn = (lo.v_[l] + hi.v_[l]) / 2;
+						if (!isfinite(xn)) {
+							done[l] = true; //no bracket to fall back on
+							continue;
+						}
+
+						const T tol = o.xtol_ * (1 + abs(xn));
+						xp.v_[l] = xn;
+						if (abs(xn - xv) <= tol || (br[l] && hi.v_[l] - lo.v_[l] <= tol))
+							done[l] = conv[l] = true;
+						else
+							all = false;
+					}
+					if (all)
+						break;
+				}
+
+				for (std::size_t l = 0; l < m; ++l) {
+					x[i + l] = xp.v_[l];
+					if (ok)
+						ok[i + l] = conv[l];
+					found += conv[l];
+				}
+			}
+			return found;
+		}
+	}
+
+	// roots of f (or of f(x) = rhs[i]) from the starting points x[i], in place,
+	// ok[i] tells whether point i converged, returns the number of converged points
+	template<typename E, typename T>
+	std::size_t newton(const E& e, T* x, std::size_t n, const solve_options<T>& o = {}, bool* ok = nullptr)
+	{
+		return solver::run<0, false>(e, x, n, o, ok);
+	}
+
+	// Halley's method, cubic convergence for one more derivative per step
+	template<typename E, typename T>
+	std::size_t halley(const E& e, T* x, std::size_t n, const solve_options<T>& o = {}, bool* ok = nullptr)
+	{
+		return solver::run<0, true>(e, x, n, o, ok);
+	}
+
+	// local minima of f: Newton steps on f`, brackets apply to f`
+	template<typename E, typename T>
+	std::size_t minimize(const E& e, T* x, std::size_t n, const solve_options<T>& o = {}, bool* ok = nullptr)
+	{
+		return solver::run<1, false>(e, x, n, o, ok);
+	}
+}
+
+#endif
@@ -0,0 +1,697 @@
+#ifndef H_EE0894B972054FE39EC6D78E1AE25CE7
+#define H_EE0894B972054FE39EC6D78E1AE25CE7
+
+#include <assert.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include "func.h"
+
+namespace metamath
+{
+	// runtime form of an expression: a flat register-based program (tape)
+	//
+	namespace vm
+	{
+		enum class op : std::uint32_t
+		{
+			cnst, //dst = consts[a]
+			var,  //dst = variable a
+			add,
+			sub,
+			mul,
+			div,
+			neg,
+			sin,
+			cos,
+			sqrt,
+			exp,
+			ln,
+			abs,
+			pow   //dst = a^n, n is stored in b
+		};
+
+		// fixed 16-byte layout
+		struct instr
+		{
+			op op_;
+			std::uint32_t dst_;
+			std::uint32_t a_;
+			std::uint32_t b_;
+		};
+
+		static constexpr std::uint32_t none = 0xffffffffu;
+
+		// points evaluated per dispatch of an instruction
+		static constexpr std::size_t block = 64;
+
+		inline bool unary(op o)
+		{
+			return o >= op::neg;
+		}
+		inline bool commutative(op o)
+		{
+			return o == op::add || o == op::mul;
+		}
+
+		template<typename T>
+		T powi(T v, std::int32_t n)
+		{
+			std::uint32_t k = n < 0 ? 0u - static_cast<std::uint32_t>(n) : static_cast<std::uint32_t>(n);
+			T r = 1;
+			while (k) {
+				if (k & 1)
+					r *= v;
+				v *= v;
+				k >>= 1;
+			}
+			return n < 0 ? 1 / r : r;
+		}
+
+		// runs a program over m points, register r of point k is regs[r * stride + k]
+		// in[v] points to the m values of variable v
+		template<typename T>
+		void run(const instr* code, std::size_t size, const T* consts,
+			const T* const* in, std::size_t m, std::size_t stride, T* regs)
+		{
+			for (std::size_t i = 0; i < size; ++i) {
+				const instr& c = code[i];
+				T* r = regs + c.dst_ * stride;
+				//a and b are registers of the arithmetic instructions only,
+				//an index, a variable or the exponent of pow otherwise
+				const T* a = c.op_ > op::var ? regs + c.a_ * stride : nullptr;
+				const T* b = c.op_ > op::var && !unary(c.op_) ? regs + c.b_ * stride : nullptr;
+
+				using std::sin;
+				using std::cos;
+				using std::sqrt;
+				using std::exp;
+				using std::log;
+				using std::abs;
+
+				switch (c.op_) {
+				case op::cnst:
+					for (std::size_t k = 0; k < m; ++k) r[k] = consts[c.a_];
+					break;
+				case op::var:
+					for (std::size_t k = 0; k < m; ++k) r[k] = in[c.a_][k];
+					break;
+				case op::add:
+					for (std::size_t k = 0; k < m; ++k) r[k] = a[k] + b[k];
+					break;
+				case op::sub:
+					for (std::size_t k = 0; k < m; ++k) r[k] = a[k] - b[k];
+					break;
+				case op::mul:
+					for (std::size_t k = 0; k < m; ++k) r[k] = a[k] * b[k];
+					break;
+				case op::div:
+					for (std::size_t k = 0; k < m; ++k) r[k] = a[k] / b[k];
+					break;
+				case op::neg:
+					for (std::size_t k = 0; k < m; ++k) r[k] = -a[k];
+					break;
+				case op::sin:
+					for (std::size_t k = 0; k < m; ++k) r[k] = sin(a[k]);
+					break;
+				case op::cos:
+					for (std::size_t k = 0; k < m; ++k) r[k] = cos(a[k]);
+					break;
+				case op::sqrt:
+					for (std::size_t k = 0; k < m; ++k) r[k] = sqrt(a[k]);
+					break;
+				case op::exp:
+					for (std::size_t k = 0; k < m; ++k) r[k] = exp(a[k]);
+					break;
+				case op::ln:
+					for (std::size_t k = 0; k < m; ++k) r[k] = log(a[k]);
+					break;
+				case op::abs:
+					for (std::size_t k = 0; k < m; ++k) r[k] = abs(a[k]);
+					break;
+				case op::pow:
+					for (std::size_t k = 0; k < m; ++k) r[k] = powi(a[k], static_cast<std::int32_t>(c.b_));
+					break;
+				}
+			}
+		}
+	}
+
+	// a tape in memory it does not own, e.g. a mapped file (see serialize.h)
+	template<typename T>
+	struct tape_view
+	{
+		typedef T type;
+
+		const vm::instr* code_ = nullptr;
+		std::size_t size_ = 0;
+		const T* consts_ = nullptr;
+		std::uint32_t regs_ = 0;
+		std::uint32_t vars_ = 0;
+		std::uint32_t out_ = 0;
+
+		std::size_t size() const
+		{
+			return size_;
+		}
+
+		// a tape of one variable, or a point with a value for every variable
+		T operator()(T v) const
+		{
+			assert(vars_ <= 1 && "the tape reads more than one variable");
+			const T* in[1] = {&v};
+			return eval(in);
+		}
+		template<std::size_t N>
+		T operator()(const point<T, N>& p) const
+		{
+			assert(vars_ <= N && "no value for a variable of the tape");
+			const T* in[N];
+			for (std::size_t i = 0; i < N; ++i)
+				in[i] = &p.v_[i];
+			return eval(in);
+		}
+
+	private:
+		// registers of tapes up to this count live on the stack
+		static constexpr std::size_t stack_regs = 64;
+
+		T eval(const T* const* in) const
+		{
+			T buf[stack_regs];
+			std::vector<T> heap;
+			T* regs = buf;
+			if (regs_ > stack_regs) {
+				heap.resize(regs_);
+				regs = heap.data();
+			}
+			vm::run(code_, size_, consts_, in, 1, 1, regs);
+			return regs[out_];
+		}
+	};
+
+	template<typename T>
+	struct tape
+	{
+		typedef T type;
+
+		std::vector<vm::instr> code_;
+		std::vector<T> consts_;
+		std::uint32_t regs_ = 0; //registers used
+		std::uint32_t vars_ = 0; //variables read
+		std::uint32_t out_ = 0;  //result register
+
+		std::size_t size() const
+		{
+			return code_.size();
+		}
+
+		tape_view<T> view() const
+		{
+			return {code_.data(), code_.size(), consts_.data(), regs_, vars_, out_};
+		}
+
+		T operator()(T v) const
+		{
+			return view()(v);
+		}
+		template<std::size_t N>
+		T operator()(const point<T, N>& p) const
+		{
+			return view()(p);
+		}
+	};
+
+	// builds a tape in SSA form (instruction i defines value i),
+	// identical instructions and constants are emitted once
+	template<typename T>
+	struct tape_builder
+	{
+		typedef T type;
+		typedef std::uint32_t ref; //SSA value
+
+		struct key_hash
+		{
+			std::size_t operator()(const vm::instr& c) const
+			{
+				std::uint64_t h = static_cast<std::uint64_t>(c.op_);
+				h = h * 0x9E3779B97F4A7C15ull ^ c.a_;
+				h = h * 0x9E3779B97F4A7C15ull ^ c.b_;
+				return static_cast<std::size_t>(h ^ (h >> 29));
+			}
+		};
+		struct key_equal
+		{
+			bool operator()(const vm::instr& l, const vm::instr& r) const
+			{
+				return l.op_ == r.op_ && l.a_ == r.a_ && l.b_ == r.b_;
+			}
+		};
+
+		std::vector<vm::instr> code_;
+		std::vector<T> consts_;
+		std::uint32_t vars_ = 0;
+		std::unordered_map<vm::instr, std::uint32_t, key_hash, key_equal> known_;
+		std::unordered_map<std::uint64_t, std::uint32_t> const_index_;
+
+		std::uint32_t emit(vm::op o, std::uint32_t a, std::uint32_t b = 0)
+		{
+			if (vm::unary(o) && o != vm::op::pow)
+				b = 0;
+			if (vm::commutative(o) && b < a)
+				std::swap(a, b);
+
+			vm::instr c{o, 0, a, b};
+			auto it = known_.find(c);
+			if (it != known_.end())
+				return it->second;
+
+			c.dst_ = static_cast<std::uint32_t>(code_.size());
+			code_.push_back(c);
+			known_.emplace(c, c.dst_);
+			return c.dst_;
+		}
+		// an operation with an immediate operand, the exponent of pow,
+		// named apart as in dag.h, where the operands are pointers
+		std::uint32_t emit_imm(vm::op o, std::uint32_t a, std::uint32_t n)
+		{
+			return emit(o, a, n);
+		}
+
+		std::uint32_t constant(T v)
+		{
+			std::uint64_t bits = 0;
+			std::memcpy(&bits, &v, sizeof(T));
+			auto it = const_index_.find(bits);
+			std::uint32_t i;
+			if (it == const_index_.end()) {
+				i = static_cast<std::uint32_t>(consts_.size());
+				consts_.push_back(v);
+				const_index_.emplace(bits, i);
+			}
+			else {
+				i = it->second;
+			}
+			return emit(vm::op::cnst, i);
+		}
+
+		std::uint32_t variable(std::uint32_t i)
+		{
+			if (i + 1 > vars_)
+				vars_ = i + 1;
+			return emit(vm::op::var, i);
+		}
+
+		// drops the instructions the result does not depend on
+		// and maps the SSA values onto a small set of registers
+		tape<T> finish(std::uint32_t out) const
+		{
+			const std::size_t n = code_.size();
+			std::vector<char> live(n, 0);
+			live[out] = 1;
+			for (std::size_t i = n; i-- > 0;) {
+				if (!live[i])
+					continue;
+				const vm::instr& c = code_[i];
+				if (c.op_ == vm::op::cnst || c.op_ == vm::op::var)
+					continue;
+				live[c.a_] = 1;
+				if (!vm::unary(c.op_))
+					live[c.b_] = 1;
+			}
+
+			std::vector<std::size_t> last(n, 0);
+			for (std::size_t i = 0; i < n; ++i) {
+				const vm::instr& c = code_[i];
+				if (!live[i] || c.op_ == vm::op::cnst || c.op_ == vm::op::var)
+					continue;
+				last[c.a_] = i;
+				if (!vm::unary(c.op_))
+					last[c.b_] = i;
+			}
+			last[out] = n;
+
+			tape<T> t;
+			t.consts_ = consts_;
+			t.vars_ = vars_;
+
+			std::vector<std::uint32_t> reg(n, vm::none);
+			std::vector<std::uint32_t> free;
+			for (std::size_t i = 0; i < n; ++i) {
+				if (!live[i])
+					continue;
+				vm::instr c = code_[i];
+				const bool operands = c.op_ != vm::op::cnst && c.op_ != vm::op::var;
+				if (operands) {
+					const std::uint32_t a = c.a_;
+					c.a_ = reg[a];
+					if (last[a] == i)
+						free.push_back(reg[a]);
+					if (!vm::unary(c.op_)) {
+						const std::uint32_t b = c.b_;
+						c.b_ = reg[b];
+						if (last[b] == i && b != a)
+							free.push_back(reg[b]);
+					}
+				}
+					//lanes are independent, dst may reuse an operand register
+				if (free.empty()) {
+					c.dst_ = t.regs_++;
+				}
+				else {
+					c.dst_ = free.back();
+					free.pop_back();
+				}
+				reg[i] = c.dst_;
+				t.code_.push_back(c);
+			}
+			t.out_ = reg[out];
+			return t;
+		}
+	};
+
+	// lowering of exp<> nodes into a builder (tape_builder or any builder
+	// with the same constant(), variable() and emit() members)
+	//
+	template<typename F>
+	struct vm_op;
+
+	template<>
+	struct vm_op<sin_f>
+	{
+		static constexpr vm::op value = vm::op::sin;
+		static constexpr std::uint32_t n = 0;
+	};
+	template<>
+	struct vm_op<cos_f>
+	{
+		static constexpr vm::op value = vm::op::cos;
+		static constexpr std::uint32_t n = 0;
+	};
+	template<>
+	struct vm_op<sqrt_f>
+	{
+		static constexpr vm::op value = vm::op::sqrt;
+		static constexpr std::uint32_t n = 0;
+	};
+	template<>
+	struct vm_op<exponent_f>
+	{
+		static constexpr vm::op value = vm::op::exp;
+		static constexpr std::uint32_t n = 0;
+	};
+	template<>
+	struct vm_op<ln_f>
+	{
+		static constexpr vm::op value = vm::op::ln;
+		static constexpr std::uint32_t n = 0;
+	};
+	template<>
+	struct vm_op<abs_f>
+	{
+		static constexpr vm::op value = vm::op::abs;
+		static constexpr std::uint32_t n = 0;
+	};
+	template<int N>
+	struct vm_op<pow_f<N>>
+	{
+		static constexpr vm::op value = vm::op::pow;
+		static constexpr std::uint32_t n = static_cast<std::uint32_t>(N);
+	};
+
+	template<typename Op>
+	struct vm_binary;
+	template<>
+	struct vm_binary<plus>
+	{
+		static constexpr vm::op value = vm::op::add;
+	};
+	template<>
+	struct vm_binary<minus>
+	{
+		static constexpr vm::op value = vm::op::sub;
+	};
+	template<>
+	struct vm_binary<mult>
+	{
+		static constexpr vm::op value = vm::op::mul;
+	};
+	template<>
+	struct vm_binary<div>
+	{
+		static constexpr vm::op value = vm::op::div;
+	};
+
+	template<typename E>
+	struct lower;
+
+	template<typename C>
+	struct lower<exp<C, empty, constant>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<C, empty, constant>& e, B& b)
+		{
+			return b.constant(static_cast<typename B::type>(e.v_));
+		}
+	};
+	// a parameter is lowered as a constant of its value at that time
+	template<typename C>
+	struct lower<exp<C, empty, parameter>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<C, empty, parameter>& e, B& b)
+		{
+			return b.constant(static_cast<typename B::type>(e.p_->v_));
+		}
+	};
+	template<int N>
+	struct lower<lit<N>>
+	{
+		template<typename B>
+		static typename B::ref emit(const lit<N>&, B& b)
+		{
+			return b.constant(static_cast<typename B::type>(N));
+		}
+	};
+	template<typename D, typename Tag>
+	struct lower<exp<D, Tag, variable>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<D, Tag, variable>& e, B& b)
+		{
+			return b.variable(static_cast<std::uint32_t>(e.index));
+		}
+	};
+	template<typename E1, typename E2, typename Op>
+	struct lower<exp<E1, E2, Op>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<E1, E2, Op>& e, B& b)
+		{
+			auto l = lower<E1>::emit(e.e1_, b);
+			auto r = lower<E2>::emit(e.e2_, b);
+			return b.emit(vm_binary<Op>::value, l, r);
+		}
+	};
+	template<typename E>
+	struct lower<exp<E, empty, negate>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<E, empty, negate>& e, B& b)
+		{
+			return b.emit(vm::op::neg, lower<E>::emit(e.e_, b));
+		}
+	};
+	template<typename E, typename F>
+	struct lower<exp<E, F, func>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<E, F, func>& e, B& b)
+		{
+			return b.emit_imm(vm_op<F>::value, lower<E>::emit(e.e_, b), vm_op<F>::n);
+		}
+	};
+
+	// polynomials lower to their Horner steps
+	template<typename E, std::size_t D, typename C>
+	struct lower<exp<E, poly_f<D, C>, func>>
+	{
+		template<typename B>
+		static typename B::ref emit(const exp<E, poly_f<D, C>, func>& e, B& b)
+		{
+			typedef typename B::type T;
+			auto r = b.constant(static_cast<T>(e.f_.c_[D]));
+			if (D == 0)
+				return r;
+			auto v = lower<E>::emit(e.e_, b);
+			for (std::size_t i = D; i-- > 0;)
+				r = b.emit(vm::op::add, b.emit(vm::op::mul, r, v), b.constant(static_cast<T>(e.f_.c_[i])));
+			return r;
+		}
+	};
+
+	// lowers an expression into a tape evaluated in T
+	template<typename T = domain, typename E>
+	tape<T> compile(const E& e)
+	{
+		tape_builder<T> b;
+		std::uint32_t out = lower<E>::emit(e, b);
+		return b.finish(out);
+	}
+
+	// batch evaluation, in[v] holds the n values of variable v
+	template<typename T>
+	void evaluate(const tape_view<T>& t, const T* const* in, T* out, std::size_t n)
+	{
+		std::vector<T> regs(t.regs_ * vm::block);
+		std::vector<const T*> args(t.vars_ ? t.vars_ : 1);
+		for (std::size_t i = 0; i < n; i += vm::block) {
+			const std::size_t m = n - i < vm::block ? n - i : vm::block;
+			for (std::size_t v = 0; v < t.vars_; ++v)
+				args[v] = in[v] + i;
+			vm::run(t.code_, t.size_, t.consts_, args.data(), m, vm::block, regs.data());
+			std::memcpy(out + i, regs.data() + t.out_ * vm::block, m * sizeof(T));
+		}
+	}
+	template<typename T>
+	void evaluate(const tape<T>& t, const T* const* in, T* out, std::size_t n)
+	{
+		evaluate(t.view(), in, out, n);
+	}
+
+	// single variable form: out[i] = t(in[i])
+	template<typename T>
+	void evaluate(const tape_view<T>& t, const T* in, T* out, std::size_t n)
+	{
+		assert(t.vars_ <= 1 && "the tape reads more than one variable");
+		evaluate(t, &in, out, n);
+	}
+	template<typename T>
+	void evaluate(const tape<T>& t, const T* in, T* out, std::size_t n)
+	{
+		evaluate(t.view(), in, out, n);
+	}
+
+	// derivative of a tape, by forward propagation of tangents
+	// into a new tape, zero tangents are never emitted
+	template<typename T>
+	tape<T> derivative(const tape<T>& t, std::uint32_t wrt)
+	{
+		using vm::op;
+		using vm::none;
+
+		tape_builder<T> b;
+		std::vector<std::uint32_t> val(t.regs_, none); //value held by a register
+		std::vector<std::uint32_t> tan(t.regs_, none); //its tangent, none is 0
+
+		auto add = [&](std::uint32_t l, std::uint32_t r) {
+			return l == none ? r : r == none ? l : b.emit(op::add, l, r);
+		};
+		auto sub = [&](std::uint32_t l, std::uint32_t r) {
+			return r == none ? l : l == none ? b.emit(op::neg, r) : b.emit(op::sub, l, r);
+		};
+		const std::uint32_t one = b.constant(T(1)); //removed by finish() when unused
+		auto mul = [&](std::uint32_t l, std::uint32_t d) {
+			return d == none ? none : d == one ? l : b.emit(op::mul, l, d);
+		};
+
+		for (const vm::instr& c : t.code_) {
+			const std::uint32_t a = c.op_ == op::cnst || c.op_ == op::var ? none : val[c.a_];
+			const std::uint32_t da = a == none ? none : tan[c.a_];
+			const std::uint32_t bv = a == none || vm::unary(c.op_) ? none : val[c.b_];
+			const std::uint32_t db = bv == none ? none : tan[c.b_];
+
+			std::uint32_t v = none;
+			std::uint32_t d = none;
+			switch (c.op_) {
+			case op::cnst:
+				v = b.constant(t.consts_[c.a_]);
+				break;
+			case op::var:
+				v = b.variable(c.a_);
+				d = c.a_ == wrt ? one : none;
+				break;
+			case op::add:
+				v = b.emit(op::add, a, bv);
+				d = add(da, db);
+				break;
+			case op::sub:
+				v = b.emit(op::sub, a, bv);
+				d = sub(da, db);
+				break;
+			case op::mul:
+				v = b.emit(op::mul, a, bv);
+				d = add(mul(bv, da), mul(a, db));
+				break;
+			case op::div:
+				v = b.emit(op::div, a, bv);
+					// (da - v * db) / b
+				if (da != none || db != none)
+					d = b.emit(op::div, sub(da, mul(v, db)), bv);
+				break;
+			case op::neg:
+				v = b.emit(op::neg, a);
+				d = da == none ? none : b.emit(op::neg, da);
+				break;
+			case op::sin:
+				v = b.emit(op::sin, a);
+				d = mul(b.emit(op::cos, a), da);
+				break;
+			case op::cos:
+				v = b.emit(op::cos, a);
+				d = da == none ? none : b.emit(op::neg, mul(b.emit(op::sin, a), da));
+				break;
+			case op::sqrt:
+				v = b.emit(op::sqrt, a);
+				d = da == none ? none : b.emit(op::div, da, b.emit(op::add, v, v));
+				break;
+			case op::exp:
+				v = b.emit(op::exp, a);
+				d = mul(v, da);
+				break;
+			case op::ln:
+				v = b.emit(op::ln, a);
+				d = da == none ? none : b.emit(op::div, da, a);
+				break;
+			case op::abs:
+				v = b.emit(op::abs, a);
+				d = da == none ? none : mul(b.emit(op::div, a, v), da);
+				break;
+			case op::pow: {
+				const std::int32_t n = static_cast<std::int32_t>(c.b_);
+				v = b.emit_imm(op::pow, a, c.b_);
+				if (da != none && n != 0) {
+					std::uint32_t p = b.emit_imm(op::pow, a, static_cast<std::uint32_t>(n - 1));
+					d = mul(b.emit(op::mul, b.constant(static_cast<T>(n)), p), da);
+				}
+				break;
+			}
+			}
+			val[c.dst_] = v;
+			tan[c.dst_] = d;
+		}
+
+		std::uint32_t out = tan[t.out_];
+		if (out == none)
+			out = b.constant(T(0));
+		return b.finish(out);
+	}
+
+	template<typename T>
+	tape<T> derivative(const tape<T>& t)
+	{
+		return derivative(t, 0);
+	}
+
+	template<typename T, typename D, typename Tag>
+	tape<T> derivative(const tape<T>& t, const exp<D, Tag, variable>& v)
+	{
+		return derivative(t, static_cast<std::uint32_t>(v.index));
+	}
+}
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef H_FD21D81248B44C6FA10CF71F21BC570F
+#define H_FD21D81248B44C6FA10CF71F21BC570F
+
+#include <cstddef>
+#include <array>
+#include <type_traits>
+#include "func.h"
+#include "batch.h"
+#include "dual.h"
+
+namespace metamath
+{
+	namespace ad
+	{
+		// truncated Taylor series of order N: c_[k] = f^(k)(x) / k!
+		// walking an expression with it yields f, f`, ..., f^(N) in one pass,
+		// the cost of every node is O(N^2) instead of the growth of nested derivative()
+		template<typename T, std::size_t N>
+		struct taylor
+		{
+			typedef T type;
+			typedef typename scalar_of<T>::type scalar;
+			static constexpr std::size_t order = N;
+
+			T c_[N + 1];
+
+			// f^(k)(x)
+			T derivative(std::size_t k) const
+			{
+				T f = c_[k];
+				for (std::size_t i = 2; i <= k; ++i)
+					f = f * static_cast<scalar>(i);
+				return f;
+			}
+
+			static taylor constant(const T& v)
+			{
+				taylor r;
+				r.c_[0] = v;
+				for (std::size_t k = 1; k <= N; ++k)
+					r.c_[k] = T(0);
+				return r;
+			}
+
+			// the series of the variable itself at v
+			static taylor variable(const T& v)
+			{
+				taylor r = constant(v);
+				if (N > 0)
+					r.c_[1 % (N + 1)] = T(1);
+				return r;
+			}
+
+			// results of expressions without a variable are constants
+			static taylor lift(const taylor& v)
+			{
+				return v;
+			}
+			template<typename U>
+			static taylor lift(const U& v)
+			{
+				return constant(T(v));
+			}
+		};
+
+		// arithmetic
+		//
+		template<typename T, std::size_t N>
+		taylor<T, N> operator+(const taylor<T, N>& a, const taylor<T, N>& b)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k)
+				r.c_[k] = a.c_[k] + b.c_[k];
+			return r;
+		}
+		template<typename T, std::size_t N, typename U, typename = if_scalar<U>>
+		taylor<T, N> operator+(const taylor<T, N>& a, U b)
+		{
+			taylor<T, N> r = a;
+			r.c_[0] = a.c_[0] + T(b);
+			return r;
+		}
+		template<typename U, typename T, std::size_t N, typename = if_scalar<U>>
+		taylor<T, N> operator+(U a, const taylor<T, N>& b)
+		{
+			return b + a;
+		}
+
+		template<typename T, std::size_t N>
+		taylor<T, N> operator-(const taylor<T, N>& a)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k)
+				r.c_[k] = -a.c_[k];
+			return r;
+		}
+
+		template<typename T, std::size_t N>
+		taylor<T, N> operator-(const taylor<T, N>& a, const taylor<T, N>& b)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k)
+				r.c_[k] = a.c_[k] - b.c_[k];
+			return r;
+		}
+		template<typename T, std::size_t N, typename U, typename = if_scalar<U>>
+		taylor<T, N> operator-(const taylor<T, N>& a, U b)
+		{
+			taylor<T, N> r = a;
+			r.c_[0] = a.c_[0] - T(b);
+			return r;
+		}
+		template<typename U, typename T, std::size_t N, typename = if_scalar<U>>
+		taylor<T, N> operator-(U a, const taylor<T, N>& b)
+		{
+			taylor<T, N> r = -b;
+			r.c_[0] = T(a) - b.c_[0];
+			return r;
+		}
+
+		// Cauchy product
+		template<typename T, std::size_t N>
+		taylor<T, N> operator*(const taylor<T, N>& a, const taylor<T, N>& b)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k) {
+				T s = a.c_[0] * b.c_[k];
+				for (std::size_t j = 1; j <= k; ++j)
+					s = s + a.c_[j] * b.c_[k - j];
+				r.c_[k] = s;
+			}
+			return r;
+		}
+		template<typename T, std::size_t N, typename U, typename = if_scalar<U>>
+		taylor<T, N> operator*(const taylor<T, N>& a, U b)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k)
+				r.c_[k] = a.c_[k] * T(b);
+			return r;
+		}
+		template<typename U, typename T, std::size_t N, typename = if_scalar<U>>
+		taylor<T, N> operator*(U a, const taylor<T, N>& b)
+		{
+			return b * a;
+		}
+
+		// q = a / b: q_k = (a_k - sum(b_j q_k-j, j = 1..k)) / b_0
+		template<typename T, std::size_t N>
+		taylor<T, N> operator/(const taylor<T, N>& a, const taylor<T, N>& b)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k) {
+				T s = a.c_[k];
+				for (std::size_t j = 1; j <= k; ++j)
+					s = s - b.c_[j] * r.c_[k - j];
+				r.c_[k] = s / b.c_[0];
+			}
+			return r;
+		}
+		template<typename T, std::size_t N, typename U, typename = if_scalar<U>>
+		taylor<T, N> operator/(const taylor<T, N>& a, U b)
+		{
+			taylor<T, N> r;
+			for (std::size_t k = 0; k <= N; ++k)
+				r.c_[k] = a.c_[k] / T(b);
+			return r;
+		}
+		template<typename U, typename T, std::size_t N, typename = if_scalar<U>>
+		taylor<T, N> operator/(U a, const taylor<T, N>& b)
+		{
+			return taylor<T, N>::constant(T(a)) / b;
+		}
+
+		// functions, by the recurrences of the derivative identities
+		// (e.g. exp` = exp a`) on the coefficients,
+		// integer powers are multiply chains and need no overload
+		//
+		template<typename T, std::size_t N>
+		taylor<T, N> exp(const taylor<T, N>& a)
+		{
+			typedef typename taylor<T, N>::scalar S;
+			using std::exp;
+
+			taylor<T, N> r;
+			r.c_[0] = exp(a.c_[0]);
+			for (std::size_t k = 1; k <= N; ++k) {
+				T s = a.c_[1] * r.c_[k - 1];
+				for (std::size_t j = 2; j <= k; ++j)
+					s = s + static_cast<S>(j) * a.c_[j] * r.c_[k - j];
+				r.c_[k] = s / static_cast<S>(k);
+			}
+			return r;
+		}
+
+		template<typename T, std::size_t N>
+		taylor<T, N> log(const taylor<T, N>& a)
+		{
+			typedef typename taylor<T, N>::scalar S;
+			using std::log;
+
+			taylor<T, N> r;
+			r.c_[0] = log(a.c_[0]);
+			for (std::size_t k = 1; k <= N; ++k) {
+				T s = static_cast<S>(k) * a.c_[k];
+				for (std::size_t j = 1; j < k; ++j)
+					s = s - static_cast<S>(j) * r.c_[j] * a.c_[k - j];
+				r.c_[k] = s / (static_cast<S>(k) * a.c_[0]);
+			}
+			return r;
+		}
+
+		// sin and cos of the same argument come out together
+		template<typename T, std::size_t N>
+		void sin_cos(const taylor<T, N>& a, taylor<T, N>& s, taylor<T, N>& c)
+		{
+			typedef typename taylor<T, N>::scalar S;
+
+			sin_f{}.fused(a.c_[0], s.c_[0], c.c_[0]);
+			for (std::size_t k = 1; k <= N; ++k) {
+				T ss = a.c_[1] * c.c_[k - 1];
+				T cs = a.c_[1] * s.c_[k - 1];
+				for (std::size_t j = 2; j <= k; ++j) {
+					ss = ss + static_cast<S>(j) * a.c_[j] * c.c_[k - j];
+					cs = cs + static_cast<S>(j) * a.c_[j] * s.c_[k - j];
+				}
+				s.c_[k] = ss / static_cast<S>(k);
+				c.c_[k] = -cs / static_cast<S>(k);
+			}
+		}
+		template<typename T, std::size_t N>
+		taylor<T, N> sin(const taylor<T, N>& a)
+		{
+			taylor<T, N> s, c;
+			sin_cos(a, s, c);
+			return s;
+		}
+		template<typename T, std::size_t N>
+		taylor<T, N> cos(const taylor<T, N>& a)
+		{
+			taylor<T, N> s, c;
+			sin_cos(a, s, c);
+			return c;
+		}
+
+		// r * r = a: r_k = (a_k - sum(r_j r_k-j, j = 1..k-1)) / 2 r_0
+		template<typename T, std::size_t N>
+		taylor<T, N> sqrt(const taylor<T, N>& a)
+		{
+			using std::sqrt;
+
+			taylor<T, N> r;
+			r.c_[0] = sqrt(a.c_[0]);
+			for (std::size_t k = 1; k <= N; ++k) {
+				T s = a.c_[k];
+				for (std::size_t j = 1; j < k; ++j)
+					s = s - r.c_[j] * r.c_[k - j];
+				r.c_[k] = s / (r.c_[0] + r.c_[0]);
+			}
+			return r;
+		}
+
+		// the sign of a_0 times a, undefined at 0 like abs`
+		template<typename T, std::size_t N>
+		taylor<T, N> abs(const taylor<T, N>& a)
+		{
+			using std::abs;
+
+			T f = abs(a.c_[0]);
+			T sign = a.c_[0] / f;
+			taylor<T, N> r;
+			r.c_[0] = f;
+			for (std::size_t k = 1; k <= N; ++k)
+				r.c_[k] = sign * a.c_[k];
+			return r;
+		}
+	}
+
+	// Taylor coefficients of f at v up to order N
+	template<std::size_t N, typename E, typename T>
+	ad::taylor<eval_domain<T>, N> taylor_series(const E& e, T v)
+	{
+		typedef ad::taylor<eval_domain<T>, N> series;
+		return series::lift(e(series::variable(eval_domain<T>(v))));
+	}
+
+	// f(v), f`(v), ..., f^(N)(v) in a single walk of the expression tree
+	template<std::size_t N, typename E, typename T>
+	std::array<eval_domain<T>, N + 1> derivatives(const E& e, T v)
+	{
+		auto s = taylor_series<N>(e, v);
+		std::array<eval_domain<T>, N + 1> r;
+		for (std::size_t k = 0; k <= N; ++k)
+			r[k] = s.derivative(k);
+		return r;
+	}
+
+	// f^(N)(v)
+	template<std::size_t N, typename E, typename T>
+	eval_domain<T> nth_derivative(const E& e, T v)
+	{
+		return taylor_series<N>(e, v).derivative(N);
+	}
+
+	// batch form: out[k][i] = f^(k)(in[i]), k = [0, N]
+	template<std::size_t N, typename E, typename T>
+	void derivatives(const E& e, const T* in, T* const* out, std::size_t n)
+	{
+		constexpr std::size_t L = simd::lanes<T>::value;
+		typedef simd::pack<T, L> pack_t;
+		typedef ad::taylor<pack_t, N> series;
+
+		std::size_t i = 0;
+		for (; i + L <= n; i += L) {
+			series s = series::lift(e(series::variable(pack_t::load(in + i))));
+			for (std::size_t k = 0; k <= N; ++k)
+				s.derivative(k).store(out[k] + i);
+		}
+		for (; i < n; ++i) {
+			auto s = taylor_series<N>(e, in[i]);
+			for (std::size_t k = 0; k <= N; ++k)
+				out[k][i] = s.derivative(k);
+		}
+	}
+
+	// batch form: out[i] = f^(N)(in[i])
+	template<std::size_t N, typename E, typename T>
+	void nth_derivative(const E& e, const T* in, T* out, std::size_t n)
+	{
+		constexpr std::size_t L = simd::lanes<T>::value;
+		typedef simd::pack<T, L> pack_t;
+		typedef ad::taylor<pack_t, N> series;
+
+		std::size_t i = 0;
+		for (; i + L <= n; i += L)
+			series::lift(e(series::variable(pack_t::load(in + i)))).derivative(N).store(out + i);
+		for (; i < n; ++i)
+			out[i] = nth_derivative<N>(e, in[i]);
+	}
+}
+
+#endif
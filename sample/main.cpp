@@ -1,5 +1,26 @@
+#include <cstdio>
 #include <iostream>
+#include <vector>
 #include "metamath/derivative.h"
+#include "metamath/batch.h"
+#include "metamath/dual.h"
+#include "metamath/gradient.h"
+#include "metamath/tape.h"
+#include "metamath/dag.h"
+#include "metamath/codegen.h"
+#include "metamath/taylor.h"
+#include "metamath/solve.h"
+#include "metamath/quadrature.h"
+#include "metamath/approx.h"
+#include "metamath/chebyshev.h"
+#include "metamath/cost.h"
+#include "metamath/profile.h"
+#include "metamath/polynomial.h"
+#include "metamath/function.h"
+#include "metamath/serialize.h"
+#include "metamath/mixed.h"
+#include "metamath/incremental.h"
+#include "metamath/parallel.h"
 
 
 using namespace metamath;
@@ -180,5 +201,358 @@ int main()
 		std::cout << "======" << std::endl << std::endl;
 	}
 
+	{
+		std::cout << "======" << std::endl;
+		constexpr auto f = Exp(x / 2) * Sin(x);
+		constexpr auto df = derivative(f);
+
+		// computed by the compiler
+		constexpr float v = f(1.f);
+		constexpr float dv = df(1.f);
+		static_assert(df(0.f) == 1, "f`(0) = 1");
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "f(1) = " << v << ", f`(1) = " << dv << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = 4 * Sin(2 * x);
+		auto df = derivative(f);
+
+		float in[10];
+		float out[10];
+		float dout[10];
+		for (int i = 0; i < 10; ++i)
+			in[i] = i * 0.1f;
+
+		evaluate(f, in, out, 10);
+		evaluate(df, in, dout, 10);
+
+		std::cout << "f(x) = " << f << std::endl;
+		for (int i = 0; i < 10; i += 3)
+			std::cout << "f(" << in[i] << ") = " << out[i] << ", f`(" << in[i] << ") = " << dout[i] << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 2) * Sin(x);
+
+		// value and slope in one pass
+		auto r = value_and_derivative(f, 1.f);
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "f(1) = " << r.v_ << ", f`(1) = " << r.d_ << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = x * y + Sin(z) * x;
+		auto p = at(2.f, 3.f, 0.5f);
+
+		std::cout << "f(x, y, z) = " << f << std::endl;
+		std::cout << "f(2, 3, 0.5) = " << f(p) << std::endl;
+		std::cout << "------" << std::endl;
+
+		auto dfdz = derivative(f, z);
+		std::cout << "df/dz = " << dfdz << std::endl;
+		std::cout << "df/dz(2, 3, 0.5) = " << dfdz(p) << std::endl;
+
+		// all partial derivatives at once
+		auto g = gradient(f, p);
+		std::cout << "grad f(2, 3, 0.5) = " << g[0] << ", " << g[1] << ", " << g[2] << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 2) * Sin(x);
+
+		// a runtime program, the same type for any expression
+		tape<float> t = compile(f);
+		tape<float> dt = derivative(t);
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "tape: " << t.size() << " instructions, " << dt.size() << " for the derivative" << std::endl;
+		std::cout << "f(1) = " << t(1.f) << ", f`(1) = " << dt(1.f) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		dag<float> g;
+
+		// parsed at runtime, equal subexpressions are shared
+		auto f = g.parse("4*sin(2*x) + ln(3*x)");
+		auto df = g.derivative(f);
+
+		std::cout << "f(x) = " << *f << std::endl;
+		std::cout << "f`(x) = " << *df << std::endl;
+		std::cout << "f(1) = " << g.compile(f)(1.f) << ", f`(1) = " << g.compile(df)(1.f) << std::endl;
+		std::cout << "graph nodes: " << g.size() << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+#if METAMATH_NATIVE
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 2) * Sin(x);
+
+		// C source of the tape, built with the installed compiler and loaded
+		tape<double> t = compile<double>(f);
+		native_function<double> nf = compile_native(t);
+		if (nf) {
+			double in[256], out[256], ref[256];
+			for (int i = 0; i < 256; ++i)
+				in[i] = (i - 128) / 32.;
+			evaluate(nf, in, out, 256);
+			evaluate(t, in, ref, 256);
+
+			int off = 0;
+			for (int i = 0; i < 256; ++i)
+				off += std::abs(out[i] - ref[i]) > 1e-12 * (1 + std::abs(ref[i]));
+			std::cout << "native f(1) = " << nf(1.) << ", tape: " << t(1.) << std::endl;
+			std::cout << "points off the tape: " << off << std::endl;
+		}
+		else {
+			std::cout << "no C compiler" << std::endl;
+		}
+		std::cout << "======" << std::endl << std::endl;
+	}
+#endif
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 2) * Sin(x);
+
+		// cache-sized chunks on all hardware threads, each point as evaluate() gives it
+		std::vector<float> in(1 << 16), out(in.size()), ref(in.size());
+		for (std::size_t i = 0; i < in.size(); ++i)
+			in[i] = i / 8192.f;
+		parallel_evaluate(derivative(f), in.data(), out.data(), in.size());
+		evaluate(derivative(f), in.data(), ref.data(), in.size());
+
+		int off = 0;
+		for (std::size_t i = 0; i < in.size(); ++i)
+			off += out[i] != ref[i];
+		std::cout << "parallel: " << in.size() << " points, " << off << " differ from evaluate()" << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 2) * Sin(x);
+
+		// f, f`, ..., f````, one pass over the tree
+		auto d = derivatives<4>(f, 1.f);
+
+		std::cout << "f(x) = " << f << std::endl;
+		for (std::size_t k = 0; k < d.size(); ++k)
+			std::cout << "f^(" << k << ")(1) = " << d[k] << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Pow<3>(x) + x;
+
+		// f(x) = rhs[i] for several right-hand sides at once
+		float rhs[] = {2, 10, 30};
+		float r[] = {1, 1, 1};
+		solve_options<float> o;
+		o.rhs_ = rhs;
+		newton(f, r, 3, o);
+
+		std::cout << "f(x) = " << f << std::endl;
+		for (int i = 0; i < 3; ++i)
+			std::cout << "f(" << r[i] << ") = " << f(r[i]) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Sin(x) * Sin(x);
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "integral of f over [0, pi] = " << integrate(f, 0., M_PI) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 8) * Sin(x) + Ln(x + 2) * Cos(3 * x);
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "exact f(1.5) = " << f(1.5f) << std::endl;
+		std::cout << "fast f(1.5) = " << with_precision<approx::fast>(f)(1.5f) << std::endl;
+		std::cout << "coarse f(1.5) = " << with_precision<approx::coarse>(f)(1.5f) << std::endl;
+
+		// subnormal arguments of log and results of exp
+		std::cout << "fast ln(1e-40) = " << with_precision<approx::fast>(Ln(x))(1e-40f)
+			<< ", exact: " << Ln(x)(1e-40f) << std::endl;
+		std::cout << "fast e^(-100) = " << with_precision<approx::fast>(Exp(x))(-100.f)
+			<< ", exact: " << Exp(x)(-100.f) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Ln(Sqrt(Exp(3 * Sin(x)) + 1));
+
+		// piecewise polynomial on [0, 10]
+		table_options<double> o;
+		o.rel_tol_ = 1e-12;
+		auto t = tabulate(f, 0., 10., o);
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "f(2.5) = " << f(2.5) << ", table: " << t(2.5) << std::endl;
+		std::cout << "segments: " << t.size() << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Sin(x) + x * Sin(x) * x;
+		auto g = canonical(f);
+		static_assert(std::is_same<decltype(g), decltype(canonical(Sin(x) * Pow<2>(x) + Sin(x)))>::value, "one type");
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "canonical: " << g << std::endl;
+		std::cout << "f```(x) = " << canonical_derivative(canonical_derivative(canonical_derivative(f))) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Sin(x) * Exp(x) / (lit<1>{} + x * x);
+		auto df = canonical_derivative(f);
+
+		std::cout << "f`(x) = " << df << std::endl;
+		std::cout << "cost: " << cost_of(df) << std::endl;
+		std::cout << "cost of derivative(): " << cost_of(derivative(f)) << std::endl;
+
+		float in[16], out[16];
+		for (int i = 0; i < 16; ++i)
+			in[i] = i / 4.f;
+		prof::profile p;
+		evaluate(profiled(df, p), in, out, 16);
+		std::cout << "16 points: " << p.total() << " operations, " << p.visits(prof::kind::mul) << " mul, "
+			<< p.visits(prof::kind::sin) + p.visits(prof::kind::cos) + p.visits(prof::kind::exp) << " calls" << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = ((((2 * x - 3) * x + 1) * x - 5) * x + 7) * x - 1;
+		auto df = polynomial(derivative(f));
+
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "polynomial: " << polynomial(f) << std::endl;
+		std::cout << "f`(x) = " << df << std::endl;
+		std::cout << "f`(2) = " << df(2.f) << ", " << cost_of(derivative(f)).ops() << " operations, "
+			<< cost_of(df).ops() << " as polynomial" << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = 3 * x * x + 2 * x + 1;
+
+		// different formulas in one container, the derivative carried along
+		std::vector<function<float(float)>> models;
+		models.emplace_back(f, derivative(f));
+		models.emplace_back(Exp(-x / 4) * Sin(3 * x));
+		models.emplace_back(Ln(Sqrt(Exp(3 * Sin(x)) + 1)));
+
+		float in[16], out[16];
+		for (int i = 0; i < 16; ++i)
+			in[i] = i / 4.f;
+		for (const auto& m : models) {
+			evaluate(m, in, out, 16);
+			std::cout << "m(2) = " << m(2.f) << ", out[8] = " << out[8] << (m.inplace() ? ", inline" : ", heap");
+			if (m.has_derivative())
+				std::cout << ", m`(2) = " << derivative(m)(2.f);
+			std::cout << std::endl;
+		}
+		std::cout << "sizeof(function<float(float)>) = " << sizeof(function<float(float)>) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Exp(x / 2) * Sin(x);
+
+		// written once, then mapped and evaluated in place
+		image_writer<float> w;
+		w.add(f);
+		w.add(derivative(f));
+		w.add(compile(Sin(x) * Cos(y)));
+		w.write("sample.mmi");
+
+		{
+			mapped_file m("sample.mmi");
+			image<float> im(m.data(), m.size());
+			std::cout << "image: " << m.size() << " bytes, " << im.size() << " tapes" << std::endl;
+			std::cout << "f(1.5) = " << f(1.5f) << ", image: " << im[0](1.5f) << std::endl;
+			std::cout << "f`(1.5) = " << derivative(f)(1.5f) << ", image: " << im[1](1.5f) << std::endl;
+			std::cout << "g(1, 2) = " << im[2](at(1.f, 2.f)) << std::endl;
+		}
+		std::remove("sample.mmi");
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		auto f = Cos(x) - 1;
+
+		// float with an error bound, the cancelling points again in double
+		double in[256], out[256];
+		for (int i = 0; i < 256; ++i)
+			in[i] = (i - 128) / 64.;
+		const mixed_options o;
+		const std::size_t redone = evaluate_mixed(f, in, out, 256, o);
+
+		// every point, the flagged ones included, within the tolerance of the double result
+		int off = 0;
+		for (int i = 0; i < 256; ++i) {
+			const double d = std::cos(in[i]) - 1;
+			off += std::abs(out[i] - d) > o.abs_tol_ + o.rel_tol_ * std::abs(d);
+		}
+
+		auto b = bounded(f, 1e-3);
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "float f(0.001) = " << b.v_ << " +- " << b.e_ << ", exact: " << std::cos(1e-3) - 1 << std::endl;
+		std::cout << "f(0.5) = " << out[160] << ", " << redone << " of 256 points in double" << std::endl;
+		std::cout << "points off the tolerance: " << off << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
+	{
+		std::cout << "======" << std::endl;
+		param<double> a("a", 1), w("w", 3);
+		const var<double> t;
+		auto f = Param(a) * Sin(t) + Exp(-t / 4) * Cos(Param(w) * t);
+
+		// fixed points, the columns that depend on a changed parameter are recomputed
+		double in[256];
+		for (int i = 0; i < 256; ++i)
+			in[i] = i / 64.;
+		auto c = cache(f, in, 256);
+		std::cout << "f(x) = " << f << std::endl;
+		std::cout << "f(2) = " << c[128] << ", " << c.computed() << " columns" << std::endl;
+		a = 2;
+		c.update();
+		std::cout << "a = 2: f(2) = " << c[128] << ", " << c.computed() << " columns recomputed" << std::endl;
+		w = 4;
+		c.update();
+		std::cout << "w = 4: f(2) = " << c[128] << ", " << c.computed() << " columns recomputed" << std::endl;
+		std::cout << "f`(x) = " << derivative(f) << std::endl;
+		std::cout << "canonical: " << canonical_derivative(Param(a) * t * t + Param(w) * t * t) << std::endl;
+		std::cout << "======" << std::endl << std::endl;
+	}
+
 	return 0;
 }